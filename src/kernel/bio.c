@@ -12,6 +12,8 @@
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+// * breadahead() starts reading a block that will be needed
+//     soon and returns at once; the disk interrupt finishes it.
 
 
 #include "types.h"
@@ -23,9 +25,16 @@
 #include "fs.h"
 #include "buf.h"
 
+// breadahead() leaves this many buffers free for bread(), which
+// panics if it finds none, and starts no more than NREADAHEAD
+// reads at once.
+#define BRESERVE   MAXOPBLOCKS
+#define NREADAHEAD 8
+
 struct {
   struct spinlock lock;
   struct buf buf[NBUF];
+  int nahead;  // reads started by breadahead() not yet done
 
   // Linked list of all buffers, through prev/next.
   // Sorted by how recently the buffer was used.
@@ -111,16 +120,11 @@ bwrite(struct buf *b)
   virtio_disk_rw(b, 1);
 }
 
-// Release a locked buffer.
-// Move to the head of the most-recently-used list.
-void
-brelse(struct buf *b)
+// Drop a reference to an unlocked buffer; the last one
+// moves it to the head of the most-recently-used list.
+static void
+bput(struct buf *b)
 {
-  if(!holdingsleep(&b->lock))
-    panic("brelse");
-
-  releasesleep(&b->lock);
-
   acquire(&bcache.lock);
   b->refcnt--;
   if (b->refcnt == 0) {
@@ -136,6 +140,96 @@ brelse(struct buf *b)
   release(&bcache.lock);
 }
 
+// Release a locked buffer.
+void
+brelse(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("brelse");
+
+  releasesleep(&b->lock);
+  bput(b);
+}
+
+// Give up a buffer breadahead() claimed. The lock cannot be
+// released with brelse(), since after a read the interrupted
+// process is not the one that took it.
+static void
+bputahead(struct buf *b)
+{
+  releasesleep(&b->lock);
+  acquire(&bcache.lock);
+  bcache.nahead--;
+  release(&bcache.lock);
+  bput(b);
+}
+
+// Start reading the indicated block into the cache without
+// waiting for it, unless it is cached already. The buffer
+// stays locked until the read is done, so a bread() of it
+// in the meantime waits for the data. Best effort: nothing
+// happens if NREADAHEAD reads are in flight, if taking a
+// buffer would leave fewer than BRESERVE free, or if no disk
+// descriptor is free.
+void
+breadahead(uint dev, uint blockno)
+{
+  struct buf *b, *victim;
+  int nfree;
+
+  acquire(&bcache.lock);
+  if(bcache.nahead >= NREADAHEAD){
+    release(&bcache.lock);
+    return;
+  }
+  nfree = 0;
+  victim = 0;
+  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
+    if(b->dev == dev && b->blockno == blockno){
+      release(&bcache.lock);
+      return;
+    }
+    if(b->refcnt == 0){
+      if(victim == 0)
+        victim = b;
+      nfree++;
+    }
+  }
+  if(nfree <= BRESERVE){
+    release(&bcache.lock);
+    return;
+  }
+  b = victim;
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = 0;
+  b->refcnt = 1;
+  bcache.nahead++;
+  release(&bcache.lock);
+  acquiresleep(&b->lock);
+
+  // A bread() of the block may have found the buffer and
+  // locked it first; then it is valid, and may even have
+  // been changed and logged since, so it must not be read.
+  if(b->valid){
+    bputahead(b);
+    return;
+  }
+  if(virtio_disk_read_async(b) < 0){
+    // Leave it invalid: a bread() waiting for it reads it.
+    bputahead(b);
+  }
+}
+
+// Called from the disk interrupt when a read started by
+// breadahead() is done.
+void
+breadahead_done(struct buf *b)
+{
+  b->valid = 1;
+  bputahead(b);
+}
+
 void
 bpin(struct buf *b) {
   acquire(&bcache.lock);
@@ -0,0 +1,250 @@
+// Directory entry cache.
+//
+// The dentry cache remembers recent results of dirlookup(),
+// keyed by (device, directory inode number, name), so that
+// namex() can resolve the components of a path it has seen
+// before without reading directory blocks. An entry with inum
+// 0 is negative: the name is known not to exist.
+//
+// Interface:
+// * dirlookup() calls dcache_lookup() first and dcache_enter()
+//   with whatever it found on a miss.
+// * dirlink() and dirunlink() call dcache_enter() for the name
+//   they add or remove.
+// * Removing a directory calls dcache_purge(), and so does
+//   build_dir_tree(), so no entries outlive their directory.
+// All of these run with the directory's inode locked, shared
+// for lookups and for dirlinkshared(). Lookups and links enter
+// a name while still holding the directory block it lives in,
+// so a lookup cannot cache a name as absent after a concurrent
+// link has entered it; that keeps the cache in step with the
+// directory's contents.
+//
+// namex() may also read the cache with no lock at all through
+// dcache_peek(). Every hash chain has a sequence count that
+// writers make odd while they change the chain and bump again
+// when done; a reader that sees an odd count, or a count that
+// moved while it looked, treats the lookup as a miss.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "file.h"
+
+#define NDHASH 1021  // hash chains
+
+struct dentry {
+  uint dev;              // 0 if unused
+  uint dinum;            // directory inode number
+  char name[DIRSIZ];
+  uint inum;             // 0 for a negative entry
+  struct dentry *hnext;  // hash chain
+  struct dentry *prev;   // LRU list
+  struct dentry *next;
+};
+
+struct {
+  struct spinlock lock;
+  int nentry;            // entries, see dcacheinit()
+  struct dentry *hash[NDHASH];
+  uint seq[NDHASH];      // per chain, odd while being changed
+
+  // Linked list of all entries, through prev/next.
+  // head.next is most recent, head.prev is least.
+  struct dentry head;
+} dcache;
+
+void
+dcacheinit(void)
+{
+  struct dentry *d, *pg;
+  int i, n;
+
+  initlock(&dcache.lock, "dcache");
+  dcache.head.prev = &dcache.head;
+  dcache.head.next = &dcache.head;
+  // 1/DMEMSHARE of free memory, but at least NDENTRY entries,
+  // a page of entries at a time as for the inode table.
+  n = freemem_size() / DMEMSHARE / PGSIZE;
+  for(i = 0; i < n || dcache.nentry < NDENTRY; i++){
+    if((pg = kalloc()) == 0)
+      panic("dcacheinit");
+    memset(pg, 0, PGSIZE);
+    for(d = pg; d + 1 <= (struct dentry*)((char*)pg + PGSIZE); d++){
+      d->next = dcache.head.next;
+      d->prev = &dcache.head;
+      dcache.head.next->prev = d;
+      dcache.head.next = d;
+      dcache.nentry++;
+    }
+  }
+}
+
+static int
+dchain(uint dev, uint dinum, char *name)
+{
+  return (namehash(name) + dinum*31 + dev) % NDHASH;
+}
+
+// Bracket a change to chain c. Caller holds dcache.lock.
+static void
+dwrite_begin(int c)
+{
+  dcache.seq[c]++;
+  __sync_synchronize();
+}
+
+static void
+dwrite_end(int c)
+{
+  __sync_synchronize();
+  dcache.seq[c]++;
+}
+
+// Find the entry for name in directory (dev, dinum).
+// Caller holds dcache.lock.
+static struct dentry*
+dfind(uint dev, uint dinum, char *name)
+{
+  struct dentry *d;
+
+  for(d = dcache.hash[dchain(dev, dinum, name)]; d; d = d->hnext)
+    if(d->dev == dev && d->dinum == dinum && namecmp(d->name, name) == 0)
+      return d;
+  return 0;
+}
+
+// Take d off its hash chain and mark it unused.
+static void
+dunhash(struct dentry *d)
+{
+  struct dentry **pp;
+  int c;
+
+  c = dchain(d->dev, d->dinum, d->name);
+  dwrite_begin(c);
+  for(pp = &dcache.hash[c]; *pp != d; pp = &(*pp)->hnext)
+    ;
+  *pp = d->hnext;
+  d->dev = 0;
+  dwrite_end(c);
+}
+
+// Move d to the front of the LRU list.
+static void
+dtouch(struct dentry *d)
+{
+  d->next->prev = d->prev;
+  d->prev->next = d->next;
+  d->next = dcache.head.next;
+  d->prev = &dcache.head;
+  dcache.head.next->prev = d;
+  dcache.head.next = d;
+}
+
+// Look name up in the cache. If it is there, set *inum (0 if
+// the name is known to be absent) and return 1.
+int
+dcache_lookup(struct inode *dp, char *name, uint *inum)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dfind(dp->dev, dp->inum, name)) == 0){
+    release(&dcache.lock);
+    return 0;
+  }
+  *inum = d->inum;
+  dtouch(d);
+  release(&dcache.lock);
+  return 1;
+}
+
+// Record that name in dp refers to inum, or to nothing if inum
+// is 0, recycling the least recently used entry. Nothing is
+// recorded for a removed directory, whose entries are gone.
+void
+dcache_enter(struct inode *dp, char *name, uint inum)
+{
+  struct dentry *d;
+  int c;
+
+  if(dp->nlink == 0)
+    return;
+  c = dchain(dp->dev, dp->inum, name);
+  acquire(&dcache.lock);
+  if((d = dfind(dp->dev, dp->inum, name)) == 0){
+    d = dcache.head.prev;
+    if(d->dev)
+      dunhash(d);
+    dwrite_begin(c);
+    d->dev = dp->dev;
+    d->dinum = dp->inum;
+    strncpy(d->name, name, DIRSIZ);
+    d->inum = inum;
+    d->hnext = dcache.hash[c];
+    dcache.hash[c] = d;
+    dwrite_end(c);
+  } else if(d->inum != inum){
+    dwrite_begin(c);
+    d->inum = inum;
+    dwrite_end(c);
+  }
+  dtouch(d);
+  release(&dcache.lock);
+}
+
+// Look name up in directory (dev, dinum) without locking, for
+// namex(). On a hit, set *inum (0 if the name is known to be
+// absent) and *seq, which dcache_valid() can later check to
+// see if the entry has changed since, and return 1. Return 0
+// on a miss or if a writer is busy with the chain.
+int
+dcache_peek(uint dev, uint dinum, char *name, uint *inum, uint *seq)
+{
+  struct dentry *d;
+  int c, n, hit;
+
+  c = dchain(dev, dinum, name);
+  *seq = dcache.seq[c];
+  __sync_synchronize();
+  if(*seq & 1)
+    return 0;
+  hit = 0;
+  // A racing writer can send the walk astray; bound it.
+  for(d = dcache.hash[c], n = 0; d && n < dcache.nentry; d = d->hnext, n++){
+    if(d->dev == dev && d->dinum == dinum && namecmp(d->name, name) == 0){
+      *inum = d->inum;
+      hit = 1;
+      break;
+    }
+  }
+  __sync_synchronize();
+  return hit && dcache.seq[c] == *seq;
+}
+
+// Has the chain of name in (dev, dinum) not changed since
+// dcache_peek() returned seq?
+int
+dcache_valid(uint dev, uint dinum, char *name, uint seq)
+{
+  __sync_synchronize();
+  return dcache.seq[dchain(dev, dinum, name)] == seq;
+}
+
+// Drop every entry of directory inode dinum.
+void
+dcache_purge(uint dev, uint dinum)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.head.next; d != &dcache.head; d = d->next)
+    if(d->dev == dev && d->dinum == dinum)
+      dunhash(d);
+  release(&dcache.lock);
+}
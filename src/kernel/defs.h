@@ -1,5 +1,6 @@
 struct buf;
 struct context;
+struct dircursor;
 struct file;
 struct inode;
 struct pipe;
@@ -9,6 +10,7 @@ struct sleeplock;
 struct stat;
 struct superblock;
 struct dirent;
+struct defragstat;
 
 // bio.c
 void            binit(void);
@@ -17,6 +19,16 @@ void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+void            breadahead(uint, uint);
+void            breadahead_done(struct buf*);
+
+// dcache.c
+void            dcacheinit(void);
+int             dcache_lookup(struct inode*, char*, uint*);
+void            dcache_enter(struct inode*, char*, uint);
+void            dcache_purge(uint, uint);
+int             dcache_peek(uint, uint, char*, uint*, uint*);
+int             dcache_valid(uint, uint, char*, uint);
 
 // console.c
 void            consoleinit(void);
@@ -34,34 +46,47 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filepread(struct file*, uint64, int, uint64);
+int             filepwrite(struct file*, uint64, int, uint64);
 
 // fs.c
 void            fsinit(int);
 int             dirlink(struct inode*, char*, uint);
+int             dirlinkshared(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
+void            dirunlink(struct inode*, char*, uint);
+int             dirempty(struct inode*);
+int             dirnext(struct inode*, uint64*, struct dircursor*, struct dirent*);
+struct sleeplock* dirnamelock(struct inode*, char*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+struct inode*   iget(uint, uint);
 void            iinit();
 void            ilock(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
+void            ilockshared(struct inode*);
+void            iunlockshared(struct inode*);
 void            iunlockput(struct inode*);
+void            iputlazy(struct inode*);
+void            iunlockputlazy(struct inode*);
 void            iupdate(struct inode*);
+void            iflush(void);
+void            ireadahead(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
-int             readi(struct inode*, int, uint64, uint, uint);
+int             readi(struct inode*, int, uint64, uint64, uint);
 void            stati(struct inode*, struct stat*);
-int             writei(struct inode*, int, uint64, uint, uint);
-void            itrunc(struct inode*);
+int             writei(struct inode*, int, uint64, uint64, uint);
+int             ioverwrite(struct inode*, int, uint64, uint64, uint);
+int             itrunc(struct inode*);
 // new
-unsigned int    BKDRHash(char * str);
-uint            cal_block_index(struct inode* dp,unsigned int bn);
-uint            contiguous_block_allocation(struct inode *ip, uint off);
-uint            tree_expand(struct inode *ip, uint off);
-void            tree_search(struct inode* dp, char* name, uint* poff, struct dirent* de,uint add);
+uint            namehash(char*);
 void            build_dir_tree(struct inode* dp,uint pinum);
 struct inode    *divesymlink(struct inode *);//new
+int             ireclaim(uint);
+int             idefrag(struct inode*, struct defragstat*);
 
 
 // ramdisk.c
@@ -78,6 +103,7 @@ int             freemem_size(void);
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
+int             log_hasroom(void);
 void            begin_op(void);
 void            end_op(void);
 int             if_log_full(void);
@@ -120,6 +146,7 @@ void            procdump(void);
 int             chmode(char *pathname, int mode);
 int             chspmode(char *pathname, char *password, int supermode);
 int             proc_num(void);
+void            kproc(void (*)(void), char*);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -135,6 +162,8 @@ void            pop_off(void);
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
+void            acquiresleepshared(struct sleeplock*);
+void            releasesleepshared(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
@@ -196,6 +225,7 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+int             virtio_disk_read_async(struct buf *);
 void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
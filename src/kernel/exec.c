@@ -21,13 +21,11 @@ exec(char *path, char **argv)
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
-  begin_op();
-
-  if((ip = namei(path)) == 0){
-    end_op();
+  // No transaction: loading the program writes nothing, and
+  // iputlazy() leaves any freeing to the reclaimer.
+  if((ip = namei(path)) == 0)
     return -1;
-  }
-  ilock(ip);
+  ilockshared(ip);  // many processes can load one program at once
 
   // Check ELF header
   if(readi(ip, 0, (uint64)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -57,8 +55,8 @@ exec(char *path, char **argv)
     if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
       goto bad;
   }
-  iunlockput(ip);
-  end_op();
+  iunlockshared(ip);
+  iputlazy(ip);
   ip = 0;
 
   p = myproc();
@@ -122,8 +120,8 @@ exec(char *path, char **argv)
   if(pagetable)
     proc_freepagetable(pagetable, sz);
   if(ip){
-    iunlockput(ip);
-    end_op();
+    iunlockshared(ip);
+    iputlazy(ip);
   }
   return -1;
 }
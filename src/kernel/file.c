@@ -76,9 +76,14 @@ fileclose(struct file *f)
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
   } else if(ff.type == FD_INODE || ff.type == FD_DEVICE){
-    begin_op();
-    iput(ff.ip);
-    end_op();
+    if(!ff.writable){
+      // read-only: don't wait for log space
+      iputlazy(ff.ip);
+    } else {
+      begin_op();
+      iput(ff.ip);
+      end_op();
+    }
   }
 }
 
@@ -91,9 +96,9 @@ filestat(struct file *f, uint64 addr)
   struct stat st;
   
   if(f->type == FD_INODE || f->type == FD_DEVICE){
-    ilock(f->ip);
+    ilockshared(f->ip);
     stati(f->ip, &st);
-    iunlock(f->ip);
+    iunlockshared(f->ip);
     if(copyout(p->pagetable, addr, (char *)&st, sizeof(st)) < 0)
       return -1;
     return 0;
@@ -132,10 +137,21 @@ fileread(struct file *f, uint64 addr, int n)
       return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
-      f->off += r;
-    iunlock(f->ip);
+    // Read with the inode shared, unless f itself is shared
+    // (after dup or fork): then the inode lock also keeps
+    // f->off consistent. Only f's holders can raise f->ref,
+    // so a ref of 1 can't change under us.
+    if(f->ref == 1){
+      ilockshared(f->ip);
+      if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
+        f->off += r;
+      iunlockshared(f->ip);
+    } else {
+      ilock(f->ip);
+      if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
+        f->off += r;
+      iunlock(f->ip);
+    }
   } else {
     panic("fileread");
   }
@@ -143,12 +159,58 @@ fileread(struct file *f, uint64 addr, int n)
   return r;
 }
 
+// Write n bytes from user address addr to ip at *off,
+// advancing *off. If private, nobody else uses *off, so
+// writes to blocks the file has can go through ioverwrite(),
+// which locks only the blocks written.
+static int
+inodewrite(struct inode *ip, uint64 addr, int n, uint64 *off, int private)
+{
+  // write a few blocks at a time to avoid exceeding
+  // the maximum log transaction size, including
+  // i-node, indirect block, allocation blocks,
+  // and 2 blocks of slop for non-aligned writes.
+  // this really belongs lower down, since writei()
+  // might be writing a device like the console.
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  int i = 0, r;
+
+  while(i < n){
+    int n1 = n - i;
+    if(n1 > max)
+      n1 = max;
+
+    begin_op();
+    r = -1;
+    if(private){
+      ilockshared(ip);
+      r = ioverwrite(ip, 1, addr + i, *off, n1);
+      iunlockshared(ip);
+    }
+    if(r < 0){
+      ilock(ip);
+      r = writei(ip, 1, addr + i, *off, n1);
+      iunlock(ip);
+    }
+    if(r > 0)
+      *off += r;
+    end_op();
+
+    if(r != n1){
+      // error from writei
+      break;
+    }
+    i += r;
+  }
+  return i == n ? n : -1;
+}
+
 // Write to file f.
 // addr is a user virtual address.
 int
 filewrite(struct file *f, uint64 addr, int n)
 {
-  int r, ret = 0;
+  int ret = 0;
 
   if(f->writable == 0)
     return -1;
@@ -178,35 +240,8 @@ filewrite(struct file *f, uint64 addr, int n)
       return -1;
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    //printf("debug:before if\n");
- 
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
-
-      if(r != n1){
-        // error from writei
-        break;
-      }
-      i += r;
-    }
-    ret = (i == n ? n : -1);
+    // f->off is ours alone if nobody else has f (see fileread()).
+    ret = inodewrite(f->ip, addr, n, &f->off, f->ref == 1);
   } else {
     panic("filewrite");
   }
@@ -214,3 +249,46 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+// new
+// Read from inode file f at offset off, without using or
+// changing f->off, so it needs only a shared inode lock
+// however many processes share f.
+int
+filepread(struct file *f, uint64 addr, int n, uint64 off)
+{
+  int r;
+
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+  if((f->ip->rwmode & 2) == 0){
+    printf("this file is not readable!");
+    return -1;
+  }
+  if(f->ip->showmode == 0){
+    printf("this file is in recycle bin\n");
+    return -1;
+  }
+
+  ilockshared(f->ip);
+  r = readi(f->ip, 1, addr, off, n);
+  iunlockshared(f->ip);
+  return r;
+}
+
+// Write to inode file f at offset off, leaving f->off alone.
+int
+filepwrite(struct file *f, uint64 addr, int n, uint64 off)
+{
+  if(f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  if((f->ip->rwmode & 1) == 0){
+    printf("this file is not writeable!\n");
+    return -1;
+  }
+  if(f->ip->showmode == 0){
+    printf("error: this file is in recycle bin\n");
+    return -1;
+  }
+
+  return inodewrite(f->ip, addr, n, &off, 1);
+}
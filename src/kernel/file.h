@@ -1,3 +1,12 @@
+// Where a listing of an indexed directory stands in its
+// index, see dirnext().
+struct dircursor {
+  uint64 off;         // file offset blk and at[] are for
+  uint blk;           // leaf being listed
+  uint gen;           // inode's dxgen when at[] was found
+  ushort at[DX_MAXLEVELS]; // entry followed at each index level
+};
+
 struct file {
   enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE } type;
   int ref; // reference count
@@ -5,7 +14,8 @@ struct file {
   char writable;
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
-  uint off;          // FD_INODE
+  uint64 off;        // FD_INODE
+  struct dircursor dc; // FD_INODE directories
   short major;       // FD_DEVICE
 };
 
@@ -16,11 +26,26 @@ struct file {
 //new
 #define NDIRECT 12
 
+// A run of logical blocks known to sit in consecutive
+// physical blocks, remembered by bmap().
+#define NMAPCACHE 4   // cached runs per in-memory inode
+struct bmapcache {
+  uint lblk;
+  uint pblk;
+  uint len;           // 0 if unused
+};
+
 // in-memory copy of an inode
 struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *lnext;  // list of references left to the reclaimer, see iputlazy()
+  struct inode *hnext;  // itable hash chain
+  struct inode *prev;   // LRU list of unreferenced inodes
+  struct inode *next;
+  int dirty;          // changed in the running transaction, see iupdate()
+  struct inode *dnext;  // list of dirty inodes
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -28,13 +53,24 @@ struct inode {
   short major;
   short minor;
   short nlink;
-  uint size;
+  uint64 size;
 
   //new
   uint rwmode; // 读写权限，00不能读不能写，01不能读可以写，10可读不能写，11能读能写（default）
   uint supermode; //是否是高级文件
-  uint addrs[NDIRECT+3];
   uint showmode; //是否显示
+  uint flags;
+  uint orphan;
+  union {
+    uint addrs[NDIRECT+3];
+    char data[IDATASIZE];
+  };
+  uint wseq;          // bumped by every write and truncate
+  uint dxgen;         // bumped when directory index entries move
+
+  struct spinlock bclock;  // protects bcache, bcnext
+  struct bmapcache bcache[NMAPCACHE]; // recently resolved runs
+  int bcnext;         // next bcache slot to replace
 };
 
 // map major device number to device functions.
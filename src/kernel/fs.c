@@ -27,6 +27,8 @@
 struct superblock sb; 
 struct spinlock sblock;
 
+static void reclaimer(void);
+
 // Read the super block.
 static void
 readsb(int dev, struct superblock *sb)
@@ -58,6 +60,7 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  kproc(reclaimer, "reclaim");
 }
 
 // Zero a block.
@@ -74,17 +77,25 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// Allocate a zeroed disk block, scanning the bitmap from
+// block goal onwards (and wrapping around) so that callers
+// can ask for the block following the one they used last.
 static uint
-balloc(uint dev)
+balloc_goal(uint dev, uint goal)
 {
-  int b, bi, m;
+  int b, bi, m, k, nbmap;
   struct buf *bp;
 
   bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
+  nbmap = (sb.size + BPB - 1) / BPB;
+  if(goal >= sb.size)
+    goal = 0;
+  // k == nbmap revisits the first bitmap block to cover the
+  // bits below goal.
+  for(k = 0; k <= nbmap; k++){
+    b = ((goal / BPB + k) % nbmap) * BPB;
     bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
+    for(bi = (k == 0 ? goal % BPB : 0); bi < BPB && b + bi < sb.size; bi++){
       m = 1 << (bi % 8);
       if((bp->data[bi/8] & m) == 0){  // Is block free?
         bp->data[bi/8] |= m;  // Mark block in use.
@@ -103,6 +114,13 @@ balloc(uint dev)
   panic("balloc: out of blocks");
 }
 
+// Allocate a zeroed disk block.
+static uint
+balloc(uint dev)
+{
+  return balloc_goal(dev, 0);
+}
+
 // Free a disk block.
 static void
 bfree(int dev, uint b)
@@ -124,6 +142,70 @@ bfree(int dev, uint b)
   updatesb(dev, &sb);
 }
 
+// Free n contiguous disk blocks starting at b, touching each
+// bitmap block and the superblock only once.
+static void
+bfree_range(int dev, uint b, uint n)
+{
+  struct buf *bp;
+  int bi, m;
+  uint freed = n;
+
+  while(n > 0){
+    bp = bread(dev, BBLOCK(b, sb));
+    do {
+      bi = b % BPB;
+      m = 1 << (bi % 8);
+      if((bp->data[bi/8] & m) == 0)
+        panic("freeing free block");
+      bp->data[bi/8] &= ~m;
+      b++;
+      n--;
+    } while(n > 0 && b % BPB != 0);
+    log_write(bp);
+    brelse(bp);
+  }
+  acquire(&sblock);
+  sb.freeblocks += freed;
+  release(&sblock);
+  updatesb(dev, &sb);
+}
+
+// Find n free blocks in a row, or failing that the longest
+// free run. Returns its first block and sets *len. Nothing is
+// allocated, so the run is only a goal for balloc_goal().
+static uint
+bfindrun(uint dev, uint n, uint *len)
+{
+  struct buf *bp;
+  uint b, bi, start, run, best, bestlen;
+
+  start = run = best = bestlen = 0;
+  for(b = 0; b < sb.size; b += BPB){
+    bp = bread(dev, BBLOCK(b, sb));
+    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
+      if(bp->data[bi/8] & (1 << (bi % 8))){
+        run = 0;
+        continue;
+      }
+      if(run++ == 0)
+        start = b + bi;
+      if(run > bestlen){
+        best = start;
+        bestlen = run;
+      }
+      if(run >= n){
+        brelse(bp);
+        *len = run;
+        return start;
+      }
+    }
+    brelse(bp);
+  }
+  *len = bestlen;
+  return best;
+}
+
 // Inodes.
 //
 // An inode describes a single unnamed file.
@@ -150,21 +232,36 @@ bfree(int dev, uint b)
 //   the reference and link counts have fallen to zero.
 //
 // * Referencing in table: an entry in the inode table
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
-//   the number of in-memory pointers to the entry (open
-//   files and current directories). iget() finds or
+//   can be recycled if ip->ref is zero. Otherwise ip->ref
+//   tracks the number of in-memory pointers to the entry
+//   (open files and current directories). iget() finds or
 //   creates a table entry and increments its ref; iput()
-//   decrements ref.
+//   decrements ref. iputlazy() does the same outside a
+//   transaction, but leaves a last reference to an unlinked
+//   inode for the reclaimer to put.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   table entry is only correct when ip->valid is 1.
 //   ilock() reads the inode from
 //   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ip->valid when it frees the inode.
+//
+// * Cached: an entry whose ref falls to zero keeps its
+//   contents, and stays on its hash chain and on an LRU
+//   list until iget() recycles it for another inode, so
+//   opening a file again need not read its dinode.
+//
+// * Dirty: iupdate() does not copy ip to its dinode but
+//   marks it dirty, and iflush() copies all dirty inodes
+//   when the transaction commits. Until then the dinode in
+//   the buffer cache may be stale, so code that reads or
+//   patches a dinode directly must go through the inode
+//   when it is in the table (see orphan_next()).
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
-//   has first locked the inode.
+//   has first locked the inode. ilockshared() locks it
+//   for examining only, together with other readers.
 //
 // Thus a typical sequence is:
 //   ip = iget(dev, inum)
@@ -187,30 +284,116 @@ bfree(int dev, uint b)
 // The itable.lock spin-lock protects the allocation of itable
 // entries. Since ip->ref indicates whether an entry is free,
 // and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold itable.lock while using any of those fields.
+// holds, one must hold itable.lock while using any of those fields
+// (and ip->dirty and the hash, LRU, lazy and dirty links).
+//
+// The table is sized at boot from the free memory, a page of
+// entries at a time, and never shrinks.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 1021  // itable hash chains
+
 struct
 {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  int ninode;         // entries, see iinit()
+  struct inode *hash[NIHASH];
+  struct inode *lazy;   // entries left to the reclaimer, see iputlazy()
+  struct inode *dirty;  // entries to copy out at commit, see iupdate()
+
+  // Unreferenced entries, through prev/next. head.next was
+  // released most recently; head.prev is recycled first.
+  struct inode lru;
 } itable;
 
+#define IHASH(dev, inum) (((inum) * 31 + (dev)) % NIHASH)
+
+#define NRANGELOCK 32  // see irangelock()
+
+struct {
+  struct spinlock lock;
+  struct {
+    struct inode *ip;  // 0 if the slot is free
+    uint first, last;  // blocks locked
+  } r[NRANGELOCK];
+} rangelocks;
+
+// Bucket locks for names being created (see dirnamelock).
+#define NNAMELOCK 31
+struct sleeplock namelocks[NNAMELOCK];
+
+// Put an unreferenced entry on the LRU list: at the front if
+// it still holds a valid inode, else at the back to be
+// recycled first. Entries that are dirty join the list only
+// once iflush() has written them. Caller holds itable.lock.
+static void
+ilru_add(struct inode *ip)
+{
+  struct inode *at;
+
+  at = ip->valid ? &itable.lru : itable.lru.prev;
+  ip->next = at->next;
+  ip->prev = at;
+  at->next->prev = ip;
+  at->next = ip;
+}
+
+static void
+ilru_remove(struct inode *ip)
+{
+  ip->next->prev = ip->prev;
+  ip->prev->next = ip->next;
+}
+
+// Find the entry for (dev, inum), referenced or not.
+// Caller holds itable.lock.
+static struct inode*
+ifind(uint dev, uint inum)
+{
+  struct inode *ip;
+
+  for(ip = itable.hash[IHASH(dev, inum)]; ip; ip = ip->hnext)
+    if(ip->dev == dev && ip->inum == inum)
+      return ip;
+  return 0;
+}
+
 void iinit()
 {
-  int i = 0;
+  struct inode *ip, *pg;
+  int i = 0, n;
 
   initlock(&itable.lock, "itable");
-  for (i = 0; i < NINODE; i++)
+  itable.lru.prev = &itable.lru;
+  itable.lru.next = &itable.lru;
+  // 1/IMEMSHARE of free memory, but at least NINODE entries.
+  n = freemem_size() / IMEMSHARE / PGSIZE;
+  for (i = 0; i < n || itable.ninode < NINODE; i++)
   {
-    initsleeplock(&itable.inode[i].lock, "inode");
+    if ((pg = kalloc()) == 0)
+      panic("iinit");
+    memset(pg, 0, PGSIZE);
+    for (ip = pg; ip + 1 <= (struct inode*)((char*)pg + PGSIZE); ip++)
+    {
+      initsleeplock(&ip->lock, "inode");
+      initlock(&ip->bclock, "bmapcache");
+      ilru_add(ip);
+      itable.ninode++;
+    }
   }
+  for (i = 0; i < NNAMELOCK; i++)
+    initsleeplock(&namelocks[i], "dirname");
+  initlock(&rangelocks.lock, "rangelocks");
 }
 
-static struct inode* iget(uint dev, uint inum);
+static void bmap_forget(struct inode *ip);
+static void icopyout(struct inode *ip, struct dinode *dip);
+static void iorphan(struct inode *ip);
+static void reclaim_kick(void);
+static void itrunc_blocks(struct inode *ip);
 
 
 // search for a free inode in inode bitmap and mark it as used
@@ -238,16 +421,31 @@ searchibmap(uint dev)
     }
     brelse(bp);
   }
-  panic("ialloc: out of free inodes");
+  return 0;  // inode 0 is never free
 }
 
-// Free an inode.
+// Free an inode whose content is gone: clear its dinode and
+// release it in the inode bitmap. The dinode is copied out
+// now rather than by iflush(), which skips entries that are
+// no longer valid since the inode may be allocated again
+// before the transaction commits.
+// Caller must hold ip->lock and be inside a transaction.
 static void
-ifree(int dev, int inum)
+ifree(struct inode *ip)
 {
   struct buf *bp;
+  uint dev = ip->dev, inum = ip->inum;
   int bi, m;
 
+  ip->type = 0;
+  ip->flags = 0;
+  ip->orphan = 0;
+  bp = bread(dev, IBLOCK(inum, sb));
+  icopyout(ip, (struct dinode*)bp->data + inum%IPB);
+  log_write(bp);
+  brelse(bp);
+  ip->valid = 0;
+
   bp = bread(dev, IBBLOCK(inum, sb));
   bi = inum % BPB;
   m = 1 << (bi % 8);
@@ -273,7 +471,10 @@ ialloc(uint dev, short type)
   struct dinode *dip;
 
 
-  inum = searchibmap(dev);
+  if((inum = searchibmap(dev)) == 0){
+    printf("ialloc: no inodes\n");
+    return 0;
+  }
   bp = bread(dev, IBLOCK(inum, sb));
   dip = (struct dinode*)bp->data + inum%IPB;
   memset(dip, 0, sizeof(*dip));
@@ -289,18 +490,72 @@ ialloc(uint dev, short type)
   return iget(dev, inum);
 }
 
-// Copy a modified in-memory inode to disk.
+// Mark a modified in-memory inode to be written to disk.
 // Must be called after every change to an ip->xxx field
-// that lives on disk.
+// that lives on disk, inside a transaction. The inode is
+// copied into its inode block only when the transaction
+// commits (see iflush()), so a run of writes to a file costs
+// one copy per commit; its first iupdate() logs the block
+// now so the log has room for it.
 // Caller must hold ip->lock.
 void
 iupdate(struct inode *ip)
 {
   struct buf *bp;
-  struct dinode *dip;
 
+  // Only iupdate() sets dirty, under ip->lock, and only
+  // iflush() clears it, when no transaction is running.
+  if(ip->dirty)
+    return;
   bp = bread(ip->dev, IBLOCK(ip->inum, sb));
-  dip = (struct dinode*)bp->data + ip->inum%IPB;
+  log_write(bp);
+  brelse(bp);
+
+  acquire(&itable.lock);
+  ip->dirty = 1;
+  ip->dnext = itable.dirty;
+  itable.dirty = ip;
+  release(&itable.lock);
+}
+
+// Copy every inode changed in the committing transaction
+// into its inode block, which iupdate() already logged.
+// Called by commit() before it writes the log; no operation
+// is running then, so none of these inodes is changing.
+// Freed inodes (not valid) were cleared on disk by ifree().
+void
+iflush(void)
+{
+  struct inode *ip;
+  struct buf *bp;
+  struct dinode *dip;
+
+  acquire(&itable.lock);
+  while((ip = itable.dirty) != 0){
+    itable.dirty = ip->dnext;
+    release(&itable.lock);
+
+    if(ip->valid){
+      bp = bread(ip->dev, IBLOCK(ip->inum, sb));
+      dip = (struct dinode*)bp->data + ip->inum%IPB;
+      icopyout(ip, dip);
+      brelse(bp);
+    }
+
+    // A dirty entry stays off the LRU list, so it could not
+    // be recycled while it waited.
+    acquire(&itable.lock);
+    ip->dirty = 0;
+    if(ip->ref == 0)
+      ilru_add(ip);
+  }
+  release(&itable.lock);
+}
+
+// Copy the on-disk fields of ip into dip.
+static void
+icopyout(struct inode *ip, struct dinode *dip)
+{
   dip->type = ip->type;
   dip->major = ip->major;
   dip->minor = ip->minor;
@@ -311,43 +566,46 @@ iupdate(struct inode *ip)
   dip->rwmode = ip->rwmode;
   dip->supermode = ip->supermode;
   dip->showmode = ip->showmode;
+  dip->flags = ip->flags;
+  dip->orphan = ip->orphan;
 
-  memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
-  log_write(bp);
-  brelse(bp);
+  memmove(dip->data, ip->data, sizeof(ip->data));
 }
 
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
-static struct inode *
+struct inode *
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, **pp;
 
   acquire(&itable.lock);
 
-  // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
-      release(&itable.lock);
-      return ip;
-    }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+  // Is the inode already in the table, in use or cached?
+  if((ip = ifind(dev, inum)) != 0){
+    if(ip->ref++ == 0 && !ip->dirty)
+      ilru_remove(ip);
+    release(&itable.lock);
+    return ip;
   }
 
-  // Recycle an inode entry.
-  if(empty == 0)
+  // Recycle the least recently used unreferenced entry.
+  ip = itable.lru.prev;
+  if(ip == &itable.lru)
     panic("iget: no inodes");
-
-  ip = empty;
+  ilru_remove(ip);
+  if(ip->dev != 0){
+    for(pp = &itable.hash[IHASH(ip->dev, ip->inum)]; *pp != ip; pp = &(*pp)->hnext)
+      ;
+    *pp = ip->hnext;
+  }
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->hnext = itable.hash[IHASH(dev, inum)];
+  itable.hash[IHASH(dev, inum)] = ip;
   release(&itable.lock);
 
   return ip;
@@ -364,6 +622,42 @@ idup(struct inode *ip)
   return ip;
 }
 
+// Inode-table read-ahead.
+//
+// ilock() reads a dinode's block only when it needs it, one
+// synchronous read at a time. Code that knows which inodes
+// it will lock next calls ireadahead() for them first, so
+// their blocks are read in parallel: getdents() does this
+// for the entries it lists. ilock() itself notices inode
+// blocks being read in order, as when sequentially numbered
+// inodes are scanned, and reads IRA_WINDOW blocks ahead.
+
+#define IRA_WINDOW 4
+
+// Start reading the block of ip's dinode, if ip isn't valid.
+// ip->valid is only a hint here, so no lock is needed.
+void
+ireadahead(struct inode *ip)
+{
+  if(!ip->valid)
+    breadahead(ip->dev, IBLOCK(ip->inum, sb));
+}
+
+// ilock() is about to read inode block blk.
+static void
+iseq_readahead(uint dev, uint blk)
+{
+  static uint last;  // a hint; a race costs a useless read
+  uint b, end;
+
+  if(blk == last + 1){
+    end = IBLOCK(sb.ninodes - 1, sb);
+    for(b = blk + 1; b <= blk + IRA_WINDOW && b <= end; b++)
+      breadahead(dev, b);
+  }
+  last = blk;
+}
+
 // Lock the given inode.
 // Reads the inode from disk if necessary.
 void
@@ -378,6 +672,7 @@ ilock(struct inode *ip)
   acquiresleep(&ip->lock);
 
   if(ip->valid == 0){
+    iseq_readahead(ip->dev, IBLOCK(ip->inum, sb));
     bp = bread(ip->dev, IBLOCK(ip->inum, sb));
     dip = (struct dinode*)bp->data + ip->inum%IPB;
     ip->type = dip->type;
@@ -390,9 +685,12 @@ ilock(struct inode *ip)
     ip->rwmode = dip->rwmode;
     ip->supermode = dip->supermode;
     ip->showmode = dip->showmode;
+    ip->flags = dip->flags;
+    ip->orphan = dip->orphan;
 
-    memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+    memmove(ip->data, dip->data, sizeof(ip->data));
     brelse(bp);
+    bmap_forget(ip);
     ip->valid = 1;
     if (ip->type == 0)
       panic("ilock: no type");
@@ -409,11 +707,51 @@ iunlock(struct inode *ip)
   releasesleep(&ip->lock);
 }
 
+// Lock the given inode shared, to read it only: readi(),
+// stati() and directory lookups. Any number of processes
+// can hold it shared at once, but not while one holds it
+// with ilock(), which anything that changes ip must use.
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  acquiresleepshared(&ip->lock);
+  while(ip->valid == 0){
+    // Reading the inode in changes it, so let ilock() do it.
+    releasesleepshared(&ip->lock);
+    ilock(ip);
+    iunlock(ip);
+    acquiresleepshared(&ip->lock);
+  }
+}
+
+void
+iunlockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("iunlockshared");
+
+  releasesleepshared(&ip->lock);
+}
+
+// Files with more blocks than this are truncated by the
+// reclaimer rather than in the caller's transaction.
+#define TRUNC_SYNC_BLOCKS NDIRECT
+
+static int
+itrunc_deferred(struct inode *ip)
+{
+  return ip->size > (uint64)TRUNC_SYNC_BLOCKS * BSIZE;
+}
+
 // Drop a reference to an in-memory inode.
 // If that was the last reference, the inode table entry can
 // be recycled.
 // If that was the last reference and the inode has no links
-// to it, free the inode (and its content) on disk.
+// to it, free the inode (and its content) on disk, or put it
+// on the orphan list if it is too big to free right away.
 // All calls to iput() must be inside a transaction in
 // case it has to free the inode.
 void
@@ -430,16 +768,45 @@ iput(struct inode *ip)
 
     release(&itable.lock);
 
-    itrunc(ip);
-    ifree(ip->dev, ip->inum);
-    ip->valid = 0;
+    if(ip->flags & I_ORPHAN){
+      // the reclaimer frees it; it may have been skipping it.
+      reclaim_kick();
+    } else if(itrunc_deferred(ip)){
+      iorphan(ip);
+    } else {
+      itrunc_blocks(ip);
+      ifree(ip);
+    }
 
     releasesleep(&ip->lock);
 
     acquire(&itable.lock);
   }
 
-  ip->ref--;
+  if(--ip->ref == 0 && !ip->dirty)
+    ilru_add(ip);
+  release(&itable.lock);
+}
+
+// Drop a reference like iput(), but without a transaction.
+// For read-only paths (open, exec, path lookup) that would
+// otherwise wait for log space just in case they drop the
+// last reference to an unlinked inode: that reference is
+// kept and handed to the reclaimer, which frees the inode in
+// a transaction of its own.
+void
+iputlazy(struct inode *ip)
+{
+  acquire(&itable.lock);
+  if(ip->ref == 1 && ip->valid && ip->nlink == 0){
+    ip->lnext = itable.lazy;
+    itable.lazy = ip;
+    release(&itable.lock);
+    reclaim_kick();
+    return;
+  }
+  if(--ip->ref == 0 && !ip->dirty)
+    ilru_add(ip);
   release(&itable.lock);
 }
 
@@ -451,6 +818,13 @@ iunlockput(struct inode *ip)
   iput(ip);
 }
 
+void
+iunlockputlazy(struct inode *ip)
+{
+  iunlock(ip);
+  iputlazy(ip);
+}
+
 // Inode content
 //
 // The content (data) associated with each inode is stored
@@ -458,76 +832,410 @@ iunlockput(struct inode *ip)
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
 // listed in block ip->addrs[NDIRECT].
 
-// Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
-static uint
-bmap(struct inode *ip, uint bn)
+// Block-mapping cache.
+//
+// Each in-memory inode remembers a few runs of logical blocks
+// that bmap() has found in consecutive physical blocks, so
+// that sequential access does not re-read the same indirect
+// blocks or extent tree nodes for every data block. A run
+// stays correct until the file is truncated (or its blocks
+// are moved), which must call bmap_forget(). Readers with
+// only a shared ip->lock fill the cache too, so it has a
+// spinlock of its own, ip->bclock.
+
+static void
+bmap_forget(struct inode *ip)
 {
-  uint addr, *a;
-  struct buf *bp;
+  acquire(&ip->bclock);
+  memset(ip->bcache, 0, sizeof(ip->bcache));
+  ip->bcnext = 0;
+  release(&ip->bclock);
+}
 
-  // new
-  // 使用extent分配有两个关键要素，起始指针和长度
-  uint p_extent_file,len_extent_file;
-  
-  if(ip->type==T_EXTENT){
-    //printf("debug:use extent!");
-    int i = 0;
-    // 找磁盘上的地址 
-    while(ip->addrs[i]!=0){
-      len_extent_file = ip->addrs[i] & 0xff; // ip的addr的最后4位表示文件长度，模256可以取出最后4位 
-      if(bn >= ip->addrs[i+1] && bn < ip->addrs[i+1] + len_extent_file){ //第n块在起点到起点+length之间，不需要分配新块
-        return (/*len_extent_file*/(ip->addrs[i] & ~ 0xff) /256) + bn - ip->addrs[i+1]; //第几个exten+单个extent内部的值
-      }
-      i++;
+// Return the cached physical block for bn, or 0.
+static uint
+bmap_cached(struct inode *ip, uint bn)
+{
+  struct bmapcache *c;
+  uint addr;
+
+  addr = 0;
+  acquire(&ip->bclock);
+  for(c = ip->bcache; c < &ip->bcache[NMAPCACHE]; c++){
+    if(c->len && bn >= c->lblk && bn - c->lblk < c->len){
+      addr = c->pblk + (bn - c->lblk);
+      break;
     }
-    // 需要分配新块
-    addr = balloc(ip->dev);
-    if(i > 0){
-      len_extent_file = ip->addrs[i-1] &0xff; // 取出地址后四位，得到文件长度
-      p_extent_file = (ip->addrs[i-1] & ~ 0xff) /256; // 前12位确定是第几个extent,也就是起始指针
-      if(addr == p_extent_file + len_extent_file){// 地址前12位是指针，后4位是长度
-        ip->addrs[i-1] = (p_extent_file *256 | (len_extent_file + 1));
-        return addr;
-      }
+  }
+  release(&ip->bclock);
+  return addr;
+}
+
+// Remember that blocks lblk..lblk+len-1 live at pblk onwards,
+// extending a cached run that this one continues.
+static void
+bmap_remember(struct inode *ip, uint lblk, uint pblk, uint len)
+{
+  struct bmapcache *c;
+
+  acquire(&ip->bclock);
+  for(c = ip->bcache; c < &ip->bcache[NMAPCACHE]; c++){
+    if(c->len && c->lblk + c->len == lblk && c->pblk + c->len == pblk){
+      c->len += len;
+      release(&ip->bclock);
+      return;
     }
-    
-    ip->addrs[i] = (addr *256 | 1); // 地址16位，地址前12位是指针，后4位是长度
-    ip->addrs[i+1] = bn;
-    return addr;
   }
-  else{
-  if(bn < NDIRECT){
-    if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
-    return addr;
+  c = &ip->bcache[ip->bcnext];
+  ip->bcnext = (ip->bcnext + 1) % NMAPCACHE;
+  c->lblk = lblk;
+  c->pblk = pblk;
+  c->len = len;
+  release(&ip->bclock);
+}
+
+// Length of the run of consecutive block numbers starting
+// at a[i] in an indirect block.
+static uint
+bmap_run(uint *a, uint i)
+{
+  uint n = 1;
+
+  while(i + n < NINDIRECT && a[i+n] == a[i] + n)
+    n++;
+  return n;
+}
+
+// Extent trees (T_EXTENT files).
+//
+// ip->addrs[] holds the root node of the tree; see the
+// layout in fs.h. Lookups binary-search one node per level,
+// so mapping a block costs O(depth) block reads. New blocks
+// are allocated next to the extent they follow, which
+// usually just grows that extent by one.
+
+#define EXT_FIRST(h) ((struct extent*)((struct extent_header*)(h) + 1))
+#define EXT_FIRST_IDX(h) ((struct extent_idx*)((struct extent_header*)(h) + 1))
+
+// One level of a root-to-leaf walk.
+struct ext_path {
+  struct buf *bp;              // 0 for the root in ip->addrs[]
+  struct extent_header *hdr;
+  int i;                       // entry followed at this level
+};
+
+// Return the root of ip's tree, initializing an empty one
+// for a freshly allocated inode. Writes the inode, so only
+// for callers that hold ip->lock exclusively.
+static struct extent_header*
+ext_root(struct inode *ip)
+{
+  struct extent_header *h = (struct extent_header*)ip->addrs;
+
+  if(h->magic != EXT_MAGIC){
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+    h->magic = EXT_MAGIC;
+    h->max = EXT_ROOT_ENTRIES;
   }
-  bn -= NDIRECT;
+  return h;
+}
 
-  if(bn < NINDIRECT){
-    // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
-    bp = bread(ip->dev, addr);
-    a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+// Index of the last entry of h whose lblk <= bn, or -1.
+// Leaf and index entries both start with lblk.
+static int
+ext_search(struct extent_header *h, uint bn)
+{
+  struct extent *e = EXT_FIRST(h);
+  int lo = 0, hi = h->entries - 1, mid, r = -1;
+
+  while(lo <= hi){
+    mid = (lo + hi) / 2;
+    if(e[mid].lblk <= bn){
+      r = mid;
+      lo = mid + 1;
+    } else
+      hi = mid - 1;
+  }
+  return r;
+}
+
+// Walk from the root to the leaf that covers (or would cover)
+// block bn, filling in path[0..depth]. Returns the depth.
+// The caller must ext_release() the path. A root that was
+// never initialized is all zeros, which reads as empty.
+static int
+ext_find(struct inode *ip, uint bn, struct ext_path *path)
+{
+  struct extent_header *h = (struct extent_header*)ip->addrs;
+  int l, depth = h->depth;
+
+  path[0].bp = 0;
+  path[0].hdr = h;
+  for(l = 0; ; l++){
+    path[l].i = ext_search(path[l].hdr, bn);
+    if(l == depth)
+      break;
+    if(path[l].i < 0)
+      path[l].i = 0;
+    path[l+1].bp = bread(ip->dev, EXT_FIRST_IDX(path[l].hdr)[path[l].i].child);
+    path[l+1].hdr = (struct extent_header*)path[l+1].bp->data;
+    if(path[l+1].hdr->magic != EXT_MAGIC)
+      panic("ext_find: bad node");
+  }
+  return depth;
+}
+
+static void
+ext_release(struct ext_path *path, int depth)
+{
+  int l;
+
+  for(l = 1; l <= depth; l++)
+    brelse(path[l].bp);
+}
+
+// Record a change to the node at path level l.
+// The root is written back by the caller's iupdate().
+static void
+ext_dirty(struct ext_path *path, int l)
+{
+  if(path[l].bp)
+    log_write(path[l].bp);
+}
+
+// The root is full: move its entries into a new block and
+// make the root a single index entry pointing there. The
+// path grows by one level below the root.
+static void
+ext_grow(struct inode *ip, struct ext_path *path)
+{
+  struct extent_header *root = path[0].hdr, *nh;
+  struct buf *bp;
+  uint nb;
+
+  if(root->depth + 1 >= EXT_MAXDEPTH)
+    panic("ext_grow: tree too deep");
+  nb = balloc(ip->dev);
+  bp = bread(ip->dev, nb);
+  nh = (struct extent_header*)bp->data;
+  memmove(nh, root, sizeof(*root) + root->entries * sizeof(struct extent));
+  nh->max = EXT_BLOCK_ENTRIES;
+  log_write(bp);
+
+  memmove(&path[2], &path[1], root->depth * sizeof(path[0]));
+  EXT_FIRST_IDX(root)[0].lblk = EXT_FIRST(nh)[0].lblk;
+  EXT_FIRST_IDX(root)[0].child = nb;
+  EXT_FIRST_IDX(root)[0].unused = 0;
+  root->entries = 1;
+  root->depth++;
+
+  path[0].i = 0;
+  path[1].bp = bp;
+  path[1].hdr = nh;
+}
+
+// Insert entry ent (a struct extent or struct extent_idx)
+// into the node at path level l, splitting full nodes on the
+// way up. Buffers created by splits are released here; the
+// ones on the path are left to the caller.
+static void
+ext_insert(struct inode *ip, struct ext_path *path, int l, void *ent)
+{
+  struct buf *bp = path[l].bp, *nbp;
+  struct extent_header *h = path[l].hdr, *nh;
+  struct extent_idx idx;
+  uint key = *(uint*)ent, nb;
+  int pos, half;
+
+  if(h->entries == h->max){
+    if(l == 0){
+      ext_grow(ip, path);
+      bp = path[1].bp;
+      h = path[1].hdr;
+    } else {
+      // Split: the upper half moves to a new sibling, which
+      // is then linked into the parent.
+      nb = balloc(ip->dev);
+      nbp = bread(ip->dev, nb);
+      nh = (struct extent_header*)nbp->data;
+      half = h->entries / 2;
+      nh->magic = EXT_MAGIC;
+      nh->max = EXT_BLOCK_ENTRIES;
+      nh->depth = h->depth;
+      nh->entries = h->entries - half;
+      memmove(EXT_FIRST(nh), EXT_FIRST(h) + half, nh->entries * sizeof(struct extent));
+      h->entries = half;
+
+      idx.lblk = EXT_FIRST(nh)[0].lblk;
+      idx.child = nb;
+      idx.unused = 0;
+      ext_insert(ip, path, l - 1, &idx);
+
+      if(key >= idx.lblk){
+        log_write(bp);
+        bp = nbp;
+        h = nh;
+      } else {
+        log_write(nbp);
+        brelse(nbp);
+        nbp = 0;
+      }
+      pos = ext_search(h, key) + 1;
+      memmove(EXT_FIRST(h) + pos + 1, EXT_FIRST(h) + pos, (h->entries - pos) * sizeof(struct extent));
+      memmove(EXT_FIRST(h) + pos, ent, sizeof(struct extent));
+      h->entries++;
       log_write(bp);
+      if(nbp)
+        brelse(nbp);
+      return;
     }
-    brelse(bp);
+  }
+
+  pos = ext_search(h, key) + 1;
+  memmove(EXT_FIRST(h) + pos + 1, EXT_FIRST(h) + pos, (h->entries - pos) * sizeof(struct extent));
+  memmove(EXT_FIRST(h) + pos, ent, sizeof(struct extent));
+  h->entries++;
+  if(bp)
+    log_write(bp);
+}
+
+// bmap() for T_EXTENT files.
+static uint
+ext_bmap(struct inode *ip, uint bn, uint goal)
+{
+  struct ext_path path[EXT_MAXDEPTH + 1];
+  struct extent *e, ne;
+  uint addr;
+  int depth, i, l;
+
+  ext_root(ip);
+  depth = ext_find(ip, bn, path);
+  e = EXT_FIRST(path[depth].hdr);
+  i = path[depth].i;
+  if(i >= 0 && bn < e[i].lblk + e[i].len){
+    addr = e[i].pblk + (bn - e[i].lblk);
+    bmap_remember(ip, e[i].lblk, e[i].pblk, e[i].len);
+    ext_release(path, depth);
     return addr;
   }
 
-  // new 二级索引
-  bn -= NINDIRECT;
-  if (bn < NINDIRECT * NINDIRECT)
-  {
-    if ((addr = ip->addrs[NDIRECT + 1]) == 0)
-    {
-      ip->addrs[NDIRECT + 1] = addr = balloc(ip->dev);
+  // Not mapped: allocate where the previous extent would
+  // continue (or at goal if there is none), and grow that
+  // extent if the block lands there.
+  if(i >= 0)
+    goal = e[i].pblk + (bn - e[i].lblk);
+  addr = balloc_goal(ip->dev, goal);
+  if(i >= 0 && e[i].lblk + e[i].len == bn && e[i].pblk + e[i].len == addr){
+    e[i].len++;
+    ext_dirty(path, depth);
+  } else {
+    // Index entries on the way down must not start above bn.
+    for(l = 0; l < depth; l++){
+      if(EXT_FIRST_IDX(path[l].hdr)[path[l].i].lblk > bn){
+        EXT_FIRST_IDX(path[l].hdr)[path[l].i].lblk = bn;
+        ext_dirty(path, l);
+      }
     }
-    bp = bread(ip->dev, addr);
-    a = (uint *)bp->data;
+    ne.lblk = bn;
+    ne.len = 1;
+    ne.pblk = addr;
+    ext_insert(ip, path, depth, &ne);
+  }
+  bmap_remember(ip, bn, addr, 1);
+  ext_release(path, ext_root(ip)->depth);
+  return addr;
+}
+
+// Like ext_bmap(), but returns 0 for an unmapped block
+// instead of allocating one. Changes nothing in the inode,
+// so a shared ip->lock is enough.
+static uint
+ext_lookup(struct inode *ip, uint bn)
+{
+  struct ext_path path[EXT_MAXDEPTH + 1];
+  struct extent *e;
+  uint addr = 0;
+  int depth, i;
+
+  if(((struct extent_header*)ip->addrs)->magic != EXT_MAGIC)
+    return 0;  // no tree yet: nothing mapped
+  depth = ext_find(ip, bn, path);
+  e = EXT_FIRST(path[depth].hdr);
+  i = path[depth].i;
+  if(i >= 0 && bn < e[i].lblk + e[i].len){
+    addr = e[i].pblk + (bn - e[i].lblk);
+    bmap_remember(ip, e[i].lblk, e[i].pblk, e[i].len);
+  }
+  ext_release(path, depth);
+  return addr;
+}
+
+// Free every block of the subtree rooted at h, whole extents
+// at a time, and the tree blocks below h.
+static void
+ext_free(struct inode *ip, struct extent_header *h)
+{
+  struct buf *bp;
+  int i;
+
+  for(i = 0; i < h->entries; i++){
+    if(h->depth == 0){
+      bfree_range(ip->dev, EXT_FIRST(h)[i].pblk, EXT_FIRST(h)[i].len);
+    } else {
+      bp = bread(ip->dev, EXT_FIRST_IDX(h)[i].child);
+      ext_free(ip, (struct extent_header*)bp->data);
+      brelse(bp);
+      bfree(ip->dev, EXT_FIRST_IDX(h)[i].child);
+    }
+  }
+}
+
+// Return the disk block address of the nth block in inode ip.
+// If there is no such block, bmap allocates one.
+static uint
+bmap(struct inode *ip, uint bn)
+{
+  uint addr, *a, lbn = bn;
+  struct buf *bp;
+
+  if((addr = bmap_cached(ip, bn)) != 0)
+    return addr;
+
+  if(ip->type==T_EXTENT)
+    return ext_bmap(ip, bn, 0);
+  else{
+  if(bn < NDIRECT){
+    if((addr = ip->addrs[bn]) == 0)
+      ip->addrs[bn] = addr = balloc(ip->dev);
+    return addr;
+  }
+  bn -= NDIRECT;
+
+  if(bn < NINDIRECT){
+    // Load indirect block, allocating if necessary.
+    if((addr = ip->addrs[NDIRECT]) == 0)
+      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+    bp = bread(ip->dev, addr);
+    a = (uint*)bp->data;
+    if((addr = a[bn]) == 0){
+      a[bn] = addr = balloc(ip->dev);
+      log_write(bp);
+    }
+    bmap_remember(ip, lbn, addr, bmap_run(a, bn));
+    brelse(bp);
+    return addr;
+  }
+
+  // new 二级索引
+  bn -= NINDIRECT;
+  if (bn < NINDIRECT * NINDIRECT)
+  {
+    if ((addr = ip->addrs[NDIRECT + 1]) == 0)
+    {
+      ip->addrs[NDIRECT + 1] = addr = balloc(ip->dev);
+    }
+    bp = bread(ip->dev, addr);
+    a = (uint *)bp->data;
     if ((addr = a[bn / NINDIRECT]) == 0)
     {
       a[bn / NINDIRECT] = addr = balloc(ip->dev);
@@ -541,6 +1249,7 @@ bmap(struct inode *ip, uint bn)
       a[bn % NINDIRECT] = addr = balloc(ip->dev);
       log_write(bp);
     }
+    bmap_remember(ip, lbn, addr, bmap_run(a, bn % NINDIRECT));
     brelse(bp);
     return addr;
   }
@@ -579,6 +1288,7 @@ bmap(struct inode *ip, uint bn)
       a[(bn % (NINDIRECT * NINDIRECT)) % NINDIRECT] = addr = balloc(ip->dev);
       log_write(bp);
     }
+    bmap_remember(ip, lbn, addr, bmap_run(a, (bn % (NINDIRECT * NINDIRECT)) % NINDIRECT));
     brelse(bp);
     return addr;
   }
@@ -587,54 +1297,64 @@ bmap(struct inode *ip, uint bn)
   panic("bmap: out of range");
 }
 
-// Truncate inode (discard contents).
-// Caller must hold ip->lock.
-void
-itrunc(struct inode *ip)
+// Like bmap(), but never allocates: returns 0 for a block
+// in a hole. Readers use it, so it must not touch the log.
+static uint
+bmap_lookup(struct inode *ip, uint bn)
+{
+  uint addr, *a, lbn = bn, idx[3];
+  int levels, l;
+  struct buf *bp;
+
+  if((addr = bmap_cached(ip, bn)) != 0)
+    return addr;
+  if(ip->type == T_EXTENT)
+    return ext_lookup(ip, bn);
+  if(bn < NDIRECT)
+    return ip->addrs[bn];
+
+  bn -= NDIRECT;
+  if(bn < NINDIRECT){
+    levels = 1;
+  } else if((bn -= NINDIRECT) < NINDIRECT * NINDIRECT){
+    levels = 2;
+  } else if((bn -= NINDIRECT * NINDIRECT) < NINDIRECT * NINDIRECT * NINDIRECT){
+    levels = 3;
+  } else
+    panic("bmap_lookup: out of range");
+  addr = ip->addrs[NDIRECT + levels - 1];
+  for(l = levels - 1; l >= 0; l--){
+    idx[l] = bn % NINDIRECT;
+    bn /= NINDIRECT;
+  }
+
+  for(l = 0; l < levels && addr != 0; l++){
+    bp = bread(ip->dev, addr);
+    a = (uint*)bp->data;
+    addr = a[idx[l]];
+    if(l == levels - 1 && addr != 0)
+      bmap_remember(ip, lbn, addr, bmap_run(a, idx[l]));
+    brelse(bp);
+  }
+  return addr;
+}
+
+// Free every block of ip in the caller's transaction.
+static void
+itrunc_blocks(struct inode *ip)
 {
   int i, j;
   struct buf *bp;
   uint *a;
-  // new
-  // 使用extent分配有两个关键要素，起始指针和长度
-  uint /*p_extent_file,*/len_extent_file;
-  
+
+  bmap_forget(ip);
+  if(ip->flags & I_INLINE){
+    memset(ip->data, 0, sizeof(ip->data));
+    return;
+  }
   if(ip->type==T_EXTENT){
-    int i = 0;
-    // 找磁盘上的地址 
-    int addr_block_to_free=-1;
-    while(ip->addrs[i]!=0){
-      len_extent_file = ip->addrs[i] %256; // ip的addr的最后4位表示文件长度，模256可以取出最后4位 
-      
-      for(int bn = ip->addrs[i+1]; bn < ip->addrs[i+1] + len_extent_file;bn++){ //第n块在起点到起点+length之间，不需要分配新块
-        addr_block_to_free=((ip->addrs[i] & ~ 0xff) /256)  + bn - ip->addrs[i+1]; //第几个exten+单个extent内部的值
-        
-        // printf("debug:*******************\n");
-        // printf("i=%d,ip->addrs[i]=%d,bn=%d,ip->addrs[i+1]=%d,ptr=%d\n",i,ip->addrs[i],bn,ip->addrs[i+1],(ip->addrs[i] & ~ 0xff) /256);
-        // printf("to free block addr:%d\n",addr_block_to_free);
-        bfree(ip->dev,addr_block_to_free);
-      }
-      ip->addrs[i] = 0;
-      i++;
-      if(i>NDIRECT+2)//可能用得上，现在还不知道是否能
-      {
-        break;
-      }
-    }
-    // // 需要分配新块
-    // addr = balloc(ip->dev);
-    // if(i > 0){
-    //   len_extent_file = ip->addrs[i-1] %256; // 取出地址后四位，得到文件长度
-    //   p_extent_file = len_extent_file /256; // 前12位确定是第几个extent,也就是起始指针
-    //   if(addr == p_extent_file + len_extent_file){// 地址前12位是指针，后4位是长度
-    //     ip->addrs[i-1] = (p_extent_file *256 | (len_extent_file + 1));
-    //     return addr;
-    //   }
-    // }
-    
-    // ip->addrs[i] = (addr *256 | 1); // 地址16位，地址前12位是指针，后4位是长度
-    // ip->addrs[i+1] = bn;
-    // return addr;
+    ext_free(ip, ext_root(ip));
+    memset(ip->addrs, 0, sizeof(ip->addrs));
   }
   else{
   for(i = 0; i < NDIRECT; i++){
@@ -730,693 +1450,1496 @@ itrunc(struct inode *ip)
       }
     }
     brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT + 1]);
-    ip->addrs[NDIRECT + 1] = 0;
+    bfree(ip->dev, ip->addrs[NDIRECT + 2]);
+    ip->addrs[NDIRECT + 2] = 0;
   }
   }
+}
+
+// Truncate inode (discard contents).
+// Caller must hold ip->lock and be inside a transaction.
+// Small files are truncated on the spot. The blocks of larger
+// ones are handed to a fresh unlinked inode, which iput()
+// puts on the orphan list for the reclaimer to free in
+// bounded transactions. Returns -1, leaving ip as it was, if
+// there is no free inode to hand them to.
+int
+itrunc(struct inode *ip)
+{
+  struct inode *tp;
+
+  if(itrunc_deferred(ip)){
+    if((tp = ialloc(ip->dev, ip->type)) == 0)
+      return -1;
+    ilock(tp);
+    memmove(tp->addrs, ip->addrs, sizeof(ip->addrs));
+    tp->size = ip->size;
+    tp->nlink = 0;
+    iupdate(tp);
+    iunlockput(tp);
+    bmap_forget(ip);
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+  } else
+    itrunc_blocks(ip);
+  // an empty file starts out inline again
+  if(ip->type == T_FILE || ip->type == T_EXTENT)
+    ip->flags |= I_INLINE;
+  ip->flags &= ~I_INDEX;
   ip->size = 0;
+  ip->wseq++;
   iupdate(ip);
+  return 0;
 }
 
-// Copy stat information from inode.
-// Caller must hold ip->lock.
-void
-stati(struct inode *ip, struct stat *st)
+// Orphan list and background truncation.
+//
+// An unlinked inode that is too big to free in one
+// transaction gets I_ORPHAN and is pushed on a list that
+// starts at sb.orphan and continues through dinode.orphan.
+// The reclaimer process frees its blocks from the end a few
+// at a time, one transaction per step, and finally removes
+// it from the list and frees the inode. The list is on disk,
+// so after a crash the reclaimer simply carries on at mount.
+// Only iput() pushes (at the head, under sblock) and only the
+// reclaimer removes.
+
+// Set when there may be work for the reclaimer; protected
+// by sblock.
+static int reclaim_pending;
+
+static void
+reclaim_kick(void)
 {
-  st->dev = ip->dev;
-  st->ino = ip->inum;
-  st->type = ip->type;
-  st->nlink = ip->nlink;
-  st->size = ip->size;
+  acquire(&sblock);
+  reclaim_pending = 1;
+  wakeup(&reclaim_pending);
+  release(&sblock);
+}
 
-  // new by ply
-  st->rwmode = ip->rwmode;
-  st->supermode = ip->supermode;
-  st->showmode = ip->showmode;
-  // new by maqi
-  for(int i = 0; i < 13; i++){
-    st->addrs[i] = ip->addrs[i];
-  }
+// Caller must hold ip->lock and be inside a transaction.
+static void
+iorphan(struct inode *ip)
+{
+  ip->flags |= I_ORPHAN;
+  acquire(&sblock);
+  ip->orphan = sb.orphan;
+  sb.orphan = ip->inum;
+  release(&sblock);
+  iupdate(ip);
+  updatesb(ip->dev, &sb);
+  reclaim_kick();
 }
 
-// Read data from inode.
-// Caller must hold ip->lock.
-// If user_dst==1, then dst is a user virtual address;
-// otherwise, dst is a kernel address.
-int
-readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
+// The inode after inum on the orphan list. The in-memory
+// inode is read if it is in the table, since its dinode may
+// not have been written yet.
+static uint
+orphan_next(uint dev, uint inum)
 {
-  uint tot, m;
+  struct inode *ip;
   struct buf *bp;
+  uint next;
 
-  if(off > ip->size || off + n < off)
-    return 0;
-  if(off + n > ip->size)
-    n = ip->size - off;
-
-  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
-    m = min(n - tot, BSIZE - off%BSIZE);
-    if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
-      brelse(bp);
-      tot = -1;
-      break;
-    }
-    brelse(bp);
+  acquire(&itable.lock);
+  if((ip = ifind(dev, inum)) != 0 && ip->valid){
+    next = ip->orphan;
+    release(&itable.lock);
+    return next;
   }
-  return tot;
+  release(&itable.lock);
+  bp = bread(dev, IBLOCK(inum, sb));
+  next = ((struct dinode*)bp->data + inum%IPB)->orphan;
+  brelse(bp);
+  return next;
 }
 
-// Write data to inode.
-// Caller must hold ip->lock.
-// If user_src==1, then src is a user virtual address;
-// otherwise, src is a kernel address.
-// Returns the number of bytes successfully written.
-// If the return value is less than the requested n,
-// there was an error of some kind.
-int writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
+// Make next follow inum on the orphan list, in its dinode
+// and in its in-memory inode if there is one. Orphans have
+// no other users, so neither needs the inode lock.
+// Caller must be inside a transaction.
+static void
+orphan_set(uint dev, uint inum, uint next)
 {
-  uint tot, m;
+  struct inode *ip;
   struct buf *bp;
 
-  if(off > ip->size || off + n < off)
-    return -1;
-  if(off + n > MAXFILE*BSIZE)
-    return -1;
-
-  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
-    m = min(n - tot, BSIZE - off%BSIZE);
-    if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
-      brelse(bp);
-      break;
-    }
-    log_write(bp);
-    brelse(bp);
-  }
+  bp = bread(dev, IBLOCK(inum, sb));
+  ((struct dinode*)bp->data + inum%IPB)->orphan = next;
+  log_write(bp);
+  brelse(bp);
+  acquire(&itable.lock);
+  if((ip = ifind(dev, inum)) != 0 && ip->valid)
+    ip->orphan = next;
+  release(&itable.lock);
+}
 
-  if(off > ip->size)
-    ip->size = off;
+// Unlink ip from the orphan list.
+static void
+iunorphan(struct inode *ip)
+{
+  uint prev, next;
 
-  // write the i-node back to disk even if the size didn't change
-  // because the loop above might have called bmap() and added a new
-  // block to ip->addrs[].
-  iupdate(ip);
+  acquire(&sblock);
+  if(sb.orphan == ip->inum){
+    sb.orphan = ip->orphan;
+    release(&sblock);
+    updatesb(ip->dev, &sb);
+    return;
+  }
+  prev = sb.orphan;
+  release(&sblock);
 
-  return tot;
+  // Pushes only change the head, so the rest of the list is
+  // stable.
+  while(prev != 0){
+    next = orphan_next(ip->dev, prev);
+    if(next == ip->inum){
+      orphan_set(ip->dev, prev, ip->orphan);
+      return;
+    }
+    prev = next;
+  }
+  panic("iunorphan");
 }
 
-// Directories
+// Blocks a truncation step may add to its transaction:
+// begin_op() reserves MAXOPBLOCKS, minus the inode block,
+// the superblock, the inode bitmap and an orphan list link.
+struct trunc_budget {
+  uint blocks[MAXOPBLOCKS];
+  int n;
+};
 
-int
-namecmp(const char *s, const char *t)
+#define TRUNC_BUDGET (MAXOPBLOCKS - 4)
+
+// Account for logging block b. Returns 0 if the step has
+// no room left for it.
+static int
+tb_charge(struct trunc_budget *tb, uint b)
 {
-  return strncmp(s, t, DIRSIZ);
+  int i;
+
+  for(i = 0; i < tb->n; i++)
+    if(tb->blocks[i] == b)
+      return 1;
+  if(tb->n == TRUNC_BUDGET)
+    return 0;
+  tb->blocks[tb->n++] = b;
+  return 1;
 }
 
-// Hash Tree
-// @author:MaQi
-// @Modify time:2022/5/1
-// @hash function
-// @param:
-//  + str: name of file
-// @return : hash value in range[0,16380]
-unsigned int BKDRHash(char * str)
-{
-    unsigned int seed=131;
-    unsigned int hash=0;
-    while (*str)
-    {
-        hash=hash*seed+(*str++);
+// Free the indirect tree *pa, levels deep (0 is a data block),
+// from its last entry backwards. Returns 1 once it is gone and
+// *pa is cleared, 0 if the budget ran out first.
+static int
+itrunc_tree(struct inode *ip, uint *pa, int levels, struct trunc_budget *tb)
+{
+  struct buf *bp;
+  uint *a;
+  int j, done;
 
+  if(*pa == 0)
+    return 1;
+  if(levels > 0){
+    bp = bread(ip->dev, *pa);
+    a = (uint*)bp->data;
+    for(j = NINDIRECT - 1; j >= 0; j--){
+      if(a[j] == 0)
+        continue;
+      if(!tb_charge(tb, *pa)){
+        brelse(bp);
+        return 0;
+      }
+      done = itrunc_tree(ip, &a[j], levels - 1, tb);
+      log_write(bp);
+      if(!done){
+        brelse(bp);
+        return 0;
+      }
     }
-    
-    return (hash % HASHRANGE)+16;// HASHRANGE是哈希值范围
-}
-
-// 相当于bmap的只计算不申请
-// 返回n对应的树第一层B树的节点
-// 第一层共有256个节点，每个节点是64项，根据n计算n属于的那个范围，确定出来这个block(64个dirent)
-/*
-直接块
-第0block . ..
-1-11block 一层0~10节点
-12存储1级链接
-间接块
-0~244,11~255
-溢出
-245~255,0~10
-*/
-uint cal_block_index(struct inode* dp,unsigned int bn)
-{
-
-  // 第一个block要留给'.'和'..'
-  // uint addr,*a;
-  // struct buf *bp;
-  if(bn<1)
-  {
-    panic("bn=0 should be given to . and ..");
-  }
-  if(bn<OVERFLOW_BLOCK)
-  return bn;
-  panic("cal_block_index: out of range");
-  /*
-  if(bn<NDIRECT)//1~11
-  {
-    // addr=dp->addrs[bn];
-    return addr;
-  }
-  //bn>=12
-  bn-=NDIRECT;
-  // 间接块和溢出都会在这里，bn最大可以达到265
-  if(bn<102 NINDIRECT)
-  {
-    return bn+NDIRECT;
-    
-    if ((addr = dp->addrs[NDIRECT]) == 0)
-      dp->addrs[NDIRECT] = addr = balloc(dp->dev);
-    bp = bread(dp->dev, addr);
-    a = (uint *)bp->data;
-    addr=a[bn];
-    // if ((addr = a[bn]) == 0)
-    // {
-    //   a[bn] = addr = balloc(ip->dev);
-    //   log_write(bp);
-    // }
     brelse(bp);
-    return addr;
-
   }
-  */
+  if(!tb_charge(tb, BBLOCK(*pa, sb)))
+    return 0;
+  bfree(ip->dev, *pa);
+  *pa = 0;
+  return 1;
 }
 
-void check_log_full()
+// Free the last extents of an extent tree, a bitmap block's
+// worth at a time. Returns 1 once the tree is empty.
+static int
+ext_trunc_step(struct inode *ip, struct trunc_budget *tb)
 {
-  int logfull=(if_log_full()==0);
-    if(logfull)
-    {
-      end_op();
-      begin_op();
+  struct ext_path path[EXT_MAXDEPTH + 1];
+  struct extent_header *h;
+  struct extent *e;
+  uint last, start;
+  int depth, l;
+
+  for(;;){
+    depth = ext_find(ip, ~0U, path);
+    h = path[depth].hdr;
+    if(h->entries == 0){
+      // Only the root can be an empty leaf.
+      ext_release(path, depth);
+      return 1;
+    }
+    e = &EXT_FIRST(h)[h->entries - 1];
+    last = e->pblk + e->len - 1;
+    start = last - last % BPB;
+    if(start < e->pblk)
+      start = e->pblk;
+    if((path[depth].bp && !tb_charge(tb, path[depth].bp->blockno)) ||
+       !tb_charge(tb, BBLOCK(last, sb))){
+      ext_release(path, depth);
+      return 0;
     }
+    bfree_range(ip->dev, start, last - start + 1);
+    e->len -= last - start + 1;
+    if(e->len == 0)
+      h->entries--;
+    ext_dirty(path, depth);
+
+    // Free tree blocks that became empty, bottom up.
+    for(l = depth; l > 0 && path[l].hdr->entries == 0; l--){
+      if(!tb_charge(tb, BBLOCK(path[l].bp->blockno, sb)) ||
+         (path[l-1].bp && !tb_charge(tb, path[l-1].bp->blockno))){
+        ext_release(path, depth);
+        return 0;
+      }
+      bfree(ip->dev, path[l].bp->blockno);
+      path[l-1].hdr->entries--;
+      ext_dirty(path, l-1);
+    }
+    if(l == 0 && path[0].hdr->entries == 0)
+      path[0].hdr->depth = 0;
+    ext_release(path, depth);
+  }
 }
 
-int check_free()
+// Free some of ip's blocks, from the end, in the caller's
+// transaction. Returns 1 once ip has no blocks left.
+// Caller must hold ip->lock.
+static int
+itrunc_step(struct inode *ip)
 {
-  int remain1=(if_log_full()==1);
-  return remain1;
+  struct trunc_budget tb;
+  int i, done;
+
+  tb.n = 0;
+  bmap_forget(ip);
+  if(ip->type == T_EXTENT)
+    done = ext_trunc_step(ip, &tb);
+  else {
+    done = 1;
+    for(i = NDIRECT + 2; i >= 0 && done; i--)
+      done = itrunc_tree(ip, &ip->addrs[i], i < NDIRECT ? 0 : i - NDIRECT + 1, &tb);
+  }
+  if(done)
+    ip->size = 0;
+  iupdate(ip);
+  return done;
 }
 
-
-// 连续分配block直到一直分配到指定off字节。
-// 返回值：申请的块数
-uint contiguous_block_allocation(struct inode *ip, uint off)
+// Do one step of work: put a reference left by iputlazy(),
+// or else work on the first orphan nobody else is using
+// (idefrag() keeps its scratch inode on the list while
+// filling it). Returns 0 if there is nothing to do.
+int
+ireclaim(uint dev)
 {
-  uint block_end_id=off/(uint)BSIZE;//需要连续分配到多少
-  uint first_block = ip->size/(uint)BSIZE;
-  if(ip->size % (uint)BSIZE !=0)
-  {
-    first_block+=1;
-  }
-  if (first_block>block_end_id){
-    // 需要分配的块已经在已经分配的块内了，不需要分配
-    return 0;
-  }
-  
-  uint block_id = first_block;
-  while(block_id<=block_end_id&&block_id<=NDIRECT-1)
-  {
-    // 分配块
-    ip->addrs[block_id] = balloc(ip->dev);
-    check_log_full();
-    block_id++;
-  }
-  
-  // 如果直接块就足够满足分配了，很简单，不需要额外申请，直接返回
-  if(block_end_id<NDIRECT)
-  {
-    return block_end_id - first_block + 1;
-  }
+  struct inode *ip, **pp;
+  uint inum;
 
-  // 直接块不能满足需要，那就到间接块中寻找，注意，虽然有
-  // 二三级链接，但是目录文件用不了那么多，其实这里限制了目录下文件数量，是直接块+间接块=268个目录项，
-  // 如果想要扩大目录下文件数量，请修改这里
-
-  uint block_addr=ip->addrs[NDIRECT],*p_data=0;
-  if(block_addr==0)
-  {
-    // 说明最后一个直接块还没使用
-    ip->addrs[NDIRECT] = balloc(ip->dev);
-    block_addr = ip->addrs[NDIRECT];
-
-    check_log_full();
+  acquire(&itable.lock);
+  for(pp = &itable.lazy; (ip = *pp) != 0; pp = &ip->lnext){
+    if(ip->dev == dev){
+      *pp = ip->lnext;
+      release(&itable.lock);
+      begin_op();
+      iput(ip);
+      end_op();
+      return 1;
+    }
   }
-  
-  struct buf *pointer_buf = bread(ip->dev, block_addr);
-    p_data = (uint *)pointer_buf->data;
-    while(block_id <= block_end_id)
-    {
-      p_data[block_id-NDIRECT] = balloc(ip->dev);
-      if(check_free())
-      {
-        log_write(pointer_buf);
-        brelse(pointer_buf);
-        end_op();
-        begin_op();
-        pointer_buf=bread(ip->dev,block_addr);
-        p_data=(uint*)pointer_buf->data;
-      }
-      block_id++;
+  release(&itable.lock);
+
+  acquire(&sblock);
+  inum = sb.orphan;
+  release(&sblock);
+  for(;;){
+    if(inum == 0)
+      return 0;
+    ip = iget(dev, inum);
+    if(ip->ref == 1)
+      break;
+    inum = orphan_next(dev, inum);
+    iput(ip);  // not the last reference, so no transaction needed
+  }
+
+  begin_op();
+  ilock(ip);
+  if(itrunc_step(ip)){
+    iunorphan(ip);
+    ifree(ip);
+  }
+  iunlock(ip);
+  iput(ip);
+  end_op();
+  return 1;
+}
+
+// Body of the reclaimer kernel process.
+static void
+reclaimer(void)
+{
+  for(;;){
+    while(ireclaim(ROOTDEV))
+      ;
+    acquire(&sblock);
+    while(!reclaim_pending)
+      sleep(&reclaim_pending, &sblock);
+    reclaim_pending = 0;
+    release(&sblock);
+  }
+}
+
+// Online defragmentation.
+//
+// idefrag() copies a file into a fresh extent inode laid out
+// in one free run, a few blocks per transaction, then swaps
+// the two block maps in a last transaction. The scratch inode
+// is on the orphan list from the start, so after the swap (or
+// a crash) the reclaimer frees whichever blocks it holds.
+// A write or truncate during the copy makes idefrag give up.
+
+// Blocks copied per transaction; the rest of MAXOPBLOCKS is
+// left for the bitmap, superblock, inode and extent blocks.
+#define DEFRAG_STEP 8
+
+// Count the runs of ip's blocks that are contiguous both in
+// the file and on disk. Holes are not counted.
+// Caller must hold ip->lock.
+static int
+iextents(struct inode *ip)
+{
+  uint bn, n, addr, prev;
+  int cnt;
+
+  n = (ip->size + BSIZE - 1) / BSIZE;
+  cnt = 0;
+  prev = 0;
+  for(bn = 0; bn < n; bn++){
+    addr = bmap_lookup(ip, bn);
+    if(addr != 0 && (prev == 0 || addr != prev + 1))
+      cnt++;
+    prev = addr;
+  }
+  return cnt;
+}
+
+// Count the runs of ip's blocks that are contiguous in the
+// file, the fewest extents any layout could give it.
+// Caller must hold ip->lock.
+static int
+iruns(struct inode *ip)
+{
+  uint bn, n, addr, prev;
+  int cnt;
+
+  n = (ip->size + BSIZE - 1) / BSIZE;
+  cnt = 0;
+  prev = 0;
+  for(bn = 0; bn < n; bn++){
+    addr = bmap_lookup(ip, bn);
+    if(addr != 0 && prev == 0)
+      cnt++;
+    prev = addr;
+  }
+  return cnt;
+}
+
+// Move ip's data into contiguous extents, making it a T_EXTENT
+// file. Fills in the extent counts before and after. A file is
+// only moved if that leaves it in fewer extents.
+// Returns 0 on success (or if there was nothing to gain),
+// -1 if ip is not a regular file or changed meanwhile.
+int
+idefrag(struct inode *ip, struct defragstat *ds)
+{
+  struct inode *tp;
+  struct buf *src, *dst;
+  uint addrs[NDIRECT+3];
+  uint n, bn, i, seq, start, len, addr;
+  short type;
+
+  // Count the extents without a transaction: the scans read
+  // every block pointer of the file and must not hold up
+  // commits.
+  ilockshared(ip);
+  if(ip->type != T_FILE && ip->type != T_EXTENT){
+    iunlockshared(ip);
+    return -1;
+  }
+  if(ip->flags & I_INLINE){
+    // no blocks to move
+    ds->before = ds->after = 0;
+    iunlockshared(ip);
+    return 0;
+  }
+  n = (ip->size + BSIZE - 1) / BSIZE;
+  ds->before = ds->after = iextents(ip);
+  seq = ip->wseq;
+  type = ip->type;
+  i = iruns(ip);
+  iunlockshared(ip);
+  if(n == 0 || ds->before <= i)
+    return 0;
+  start = bfindrun(ip->dev, n, &len);
+  if(len < n && type == T_EXTENT)
+    return 0;
+
+  begin_op();
+  if((tp = ialloc(ip->dev, T_EXTENT)) == 0){
+    end_op();
+    return -1;
+  }
+  ilock(tp);
+  tp->nlink = 0;
+  iorphan(tp);
+  iunlock(tp);
+  end_op();
+
+  for(bn = 0; ; bn += DEFRAG_STEP){
+    begin_op();
+    ilock(ip);
+    ilock(tp);
+    if(ip->wseq != seq)
+      goto abort;
+    if(bn >= n){
+      if(iextents(tp) >= ds->before)
+        goto keep;  // the free space was too broken up
+      break;  // still locked, for the swap
+    }
+    for(i = bn; i < n && i < bn + DEFRAG_STEP; i++){
+      if((addr = bmap_lookup(ip, i)) == 0)
+        continue;  // keep holes
+      src = bread(ip->dev, addr);
+      dst = bread(ip->dev, ext_bmap(tp, i, start + i));
+      memmove(dst->data, src->data, BSIZE);
+      log_write(dst);
+      brelse(src);
+      brelse(dst);
     }
-  log_write(pointer_buf);
-  brelse(pointer_buf);
-  
-  return block_end_id - first_block + 1;
+    tp->size = (uint64)i * BSIZE;
+    iupdate(tp);
+    iunlock(tp);
+    iunlock(ip);
+    end_op();
+  }
+
+  // Swap the block maps; tp leaves with the old blocks.
+  memmove(addrs, ip->addrs, sizeof(addrs));
+  memmove(ip->addrs, tp->addrs, sizeof(addrs));
+  memmove(tp->addrs, addrs, sizeof(addrs));
+  ip->type = T_EXTENT;
+  tp->type = type;
+  tp->size = ip->size;
+  bmap_forget(ip);
+  bmap_forget(tp);
+  iupdate(ip);
+  iupdate(tp);
+  ds->after = iextents(ip);
+  iunlock(tp);
+  iunlock(ip);
+  iput(tp);
+  end_op();
+  return 0;
+
+keep:
+  iunlock(tp);
+  iunlock(ip);
+  iput(tp);
+  end_op();
+  return 0;
+
+abort:
+  iunlock(tp);
+  iunlock(ip);
+  iput(tp);
+  end_op();
+  return -1;
 }
 
-// todo!!
-// 把dp->size的大小扩容至指定大小
-uint tree_expand(struct inode *ip, uint size)
+// Copy stat information from inode.
+// Caller must hold ip->lock.
+void
+stati(struct inode *ip, struct stat *st)
 {
-  uint allocated_block_num = contiguous_block_allocation(ip, size);
-  uint old_block_num = (ip->size-1)/BSIZE;
-  if(ip->size<1)
-  {
-    old_block_num=0;
+  st->dev = ip->dev;
+  st->ino = ip->inum;
+  st->type = ip->type;
+  st->nlink = ip->nlink;
+  st->size = ip->size;
+
+  // new by ply
+  st->rwmode = ip->rwmode;
+  st->supermode = ip->supermode;
+  st->showmode = ip->showmode;
+  // new by maqi
+  for(int i = 0; i < NDIRECT+3; i++){
+    st->addrs[i] = ip->addrs[i];
+  }
+}
+
+// Move the contents of an inline file out to a data block,
+// turning ip into an ordinary file of its type.
+// Caller must hold ip->lock and be inside a transaction.
+static void
+iuninline(struct inode *ip)
+{
+  char data[IDATASIZE];
+  struct buf *bp;
+
+  memmove(data, ip->data, sizeof(data));
+  memset(ip->data, 0, sizeof(ip->data));
+  ip->flags &= ~I_INLINE;
+  if(ip->size > 0){
+    bp = bread(ip->dev, bmap(ip, 0));
+    memmove(bp->data, data, ip->size);
+    log_write(bp);
+    brelse(bp);
   }
-  uint inner_off=ip->size%(uint)BSIZE;
+}
 
-  uint right = size + 1;
-  if(allocated_block_num!=0)right=old_block_num*BSIZE+BSIZE;
+// What holes read as.
+static char zeroblock[BSIZE];
 
-  if(inner_off==0){
-    ip->size = size + 1;
-    iupdate(ip);
-    return size;
+// Read data from inode.
+// Caller must hold ip->lock.
+// If user_dst==1, then dst is a user virtual address;
+// otherwise, dst is a kernel address.
+// Never allocates, so callers need no transaction.
+int
+readi(struct inode *ip, int user_dst, uint64 dst, uint64 off, uint n)
+{
+  uint tot, m, addr;
+  struct buf *bp;
+
+  if(off > ip->size || off + n < off)
+    return 0;
+  if(off + n > ip->size)
+    n = ip->size - off;
+
+  if(ip->flags & I_INLINE){
+    if(either_copyout(user_dst, dst, ip->data + off, n) == -1)
+      return -1;
+    return n;
   }
-  
-  struct buf *p_buf=bread(ip->dev,bmap(ip,old_block_num));
-  memset(p_buf->data + inner_off, 0, right-ip->size);
-  log_write(p_buf);
-  brelse(p_buf);
-  
-  ip->size = size + 1;
+
+  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    m = min(n - tot, BSIZE - off%BSIZE);
+    if((addr = bmap_lookup(ip, off/BSIZE)) == 0){
+      // a hole reads as zeros
+      if(either_copyout(user_dst, dst, zeroblock, m) == -1) {
+        tot = -1;
+        break;
+      }
+      continue;
+    }
+    bp = bread(ip->dev, addr);
+    if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
+      brelse(bp);
+      tot = -1;
+      break;
+    }
+    brelse(bp);
+  }
+  return tot;
+}
+
+// Write data to inode.
+// Caller must hold ip->lock.
+// If user_src==1, then src is a user virtual address;
+// otherwise, src is a kernel address.
+// Returns the number of bytes successfully written.
+// If the return value is less than the requested n,
+// there was an error of some kind.
+int writei(struct inode *ip, int user_src, uint64 src, uint64 off, uint n)
+{
+  uint tot, m;
+  struct buf *bp;
+
+  // Writing past the end leaves a hole, which has no blocks
+  // until something is written there.
+  if(off + n < off)
+    return -1;
+  if(off + n > MAXFILE*BSIZE)
+    return -1;
+
+  if(ip->flags & I_INLINE){
+    if(off + n > IDATASIZE)
+      iuninline(ip);
+    else {
+      if(either_copyin(ip->data + off, user_src, src, n) == -1)
+        return -1;
+      if(off + n > ip->size)
+        ip->size = off + n;
+      if(n > 0)
+        ip->wseq++;
+      iupdate(ip);
+      return n;
+    }
+  }
+
+  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
+    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    m = min(n - tot, BSIZE - off%BSIZE);
+    if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
+      brelse(bp);
+      break;
+    }
+    log_write(bp);
+    brelse(bp);
+  }
+
+  if(off > ip->size)
+    ip->size = off;
+  if(tot > 0)
+    ip->wseq++;
+
+  // write the i-node back to disk even if the size didn't change
+  // because the loop above might have called bmap() and added a new
+  // block to ip->addrs[].
   iupdate(ip);
-  return size;
-}
-
-// tree_search
-// @author: MaQi
-// @param:
-//  + dp:父目录，将在该目录下查找
-//  + name: 要查找的目录项
-//  + poff: 找到的位置对应的偏移量
-//  + de: 目录项指针
-// 返回值：如果找到了dirent，计算结果将保存在de中，并把偏移量写在poff中，
-//         如果没有找到，把de->inum设置为0
-void tree_search(struct inode* dp, char* name, uint* poff, struct dirent* de,uint add)
-{
-  
-  uint tree_node_off=0, tree_next_node_off=0;//,tree_node_block=1;// 以字节为单位的内存偏移量
-  unsigned int hash_value;
-  /*
-  unsigned int lower_bound_block;
-  unsigned int inner_node_off;//[0,15]*sizeof(de)
-  */
-  //uint tree_node_index=0;
-  //while(tree_node_off<MAXFSIZE){
-  //printf("in tree_search: tree_node_off%d dp->size:%d\n",tree_node_off,dp->size);
-  hash_value=BKDRHash(name);
-  //printf("name%s\n",name);
-    //printf("hash_value:%d\n",hash_value);
-    // 计算哈希值[64,17137-1+64]
-
-    /*
-    // 确定哈希值对应的哈希范围，然后确定block，一个block有64个dirent，
-    // lower_bound>=1,[1,256+1)
-    //  printf("NUM_DIRENT_PER_BLOCK:%d\n",NUM_DIRENT_PER_BLOCK);
-    lower_bound_block=hash_value/16;
-    //   printf("lower_bound_block:%d\n",lower_bound_block);
-    inner_node_off=hash_value%(NUM_DIRENT_PER_BLOCK/4)*4*sizeof(struct dirent);
-    
-    // upper_bound=lower_bound+NUM_DIRENT_PER_BLOCK;
-    // 第一块要留给'.'和'..'
-    tree_node_block=cal_block_index(dp,lower_bound_block);
-    
-    tree_node_off=tree_node_block*BSIZE+inner_node_off;
-    tree_next_node_off=tree_node_off+4*sizeof(struct dirent);
-    */
-    tree_node_off=hash_value*16*sizeof(struct dirent);
-    tree_next_node_off=(hash_value+1)*16*sizeof(struct dirent);
-
-        
-    //printf("tree_node_off:%d\n",tree_node_off);
-    //printf("tree_next_node_off:%d\n",tree_next_node_off);
-    if(tree_node_off>MAXFSIZE)
-    {
-      printf("name:%s\n",name);
-          printf("hash_value:%d\n",hash_value);
-          //printf("lower_bound_block:%d\n",lower_bound_block);
-          //printf("tree_node_block:%d\n",tree_node_block);
-          printf("tree_node_off:%d\n",tree_node_off);
-          printf("tree_next_node_off:%d\n",tree_next_node_off);
-          printf("dp->size:%d\n",dp->size);
-      panic("off bigger than MAXFSSIZE\n");
+
+  return tot;
+}
+
+// Block-range locks.
+//
+// A write that only overwrites blocks a file already has
+// changes nothing in the inode, so ioverwrite() holds the
+// inode shared and locks just the range of blocks it writes;
+// writes to disjoint ranges of one file then run in
+// parallel. Writes that allocate blocks or grow the file
+// still use writei() under ilock(), which waits for every
+// shared holder and so for all range locks on the inode.
+
+// Lock blocks first..last of ip, waiting while any of them
+// are locked. Returns the slot for irangeunlock().
+static int
+irangelock(struct inode *ip, uint first, uint last)
+{
+  int i, fr;
+
+  acquire(&rangelocks.lock);
+  for(;;){
+    fr = -1;
+    for(i = 0; i < NRANGELOCK; i++){
+      if(rangelocks.r[i].ip == 0){
+        if(fr < 0)
+          fr = i;
+      } else if(rangelocks.r[i].ip == ip &&
+                first <= rangelocks.r[i].last && rangelocks.r[i].first <= last)
+        break;
     }
-    //tree_next_node_off=min(cal_block_index(dp,lower_bound_block+1)*BSIZE,MAXFSIZE);
-
-
-    // debug
-    // if(add==1)
-    //       {
-    //         printf("in add file mode. \n");
-    //       }
-    //       else{
-    //         printf("in find file mode. \n");
-    //       }
-    // printf("name:%s\n",name);
-    //       printf("hash_value:%d\n",hash_value);
-    //       printf("lower_bound_block:%d\n",lower_bound_block);
-    //       printf("tree_node_block:%d\n",tree_node_block);
-    //       printf("tree_node_off:%d\n",tree_node_off);
-    //       printf("tree_next_node_off:%d\n",tree_next_node_off);
-    //       printf("dp->size:%d\n",dp->size);
-    
-    
-    // 在这个block内部进行线性查找（不一定要按照线性，先按照线性写
-    for(;tree_node_off<tree_next_node_off;tree_node_off+=sizeof(struct dirent))
-    {
-        // 根据需要进行扩容，搜索的话不需要扩容，而新建的话需要扩容
-        if(tree_node_off>=dp->size){
-          if(add==1){
-            //debug
-            //printf("off %d, stop_off %d, pre_size %d\n",tree_node_off,tree_next_node_off,dp->size);
-            tree_expand(dp,tree_next_node_off-1);
-            //printf("now_size %d\n",dp->size);
-          }
-          else{
-            de->inum=0;
-            return;
-          }
-        }
-        
-        if (readi(dp, 0, (uint64)de, tree_node_off, sizeof(struct dirent)) != sizeof(struct dirent)){
-          if(add==1)
-          {
-            printf("in add file mode\n");
-          }
-          else{
-            printf("in find file mode\n");
-          }
-          printf("name:%s\n",name);
-          printf("hash_value:%d\n",hash_value);
-          //printf("lower_bound_block:%d\n",lower_bound_block);
-          //printf("tree_node_block:%d\n",tree_node_block);
-          printf("tree_node_off:%d\n",tree_node_off);
-          printf("dp->size:%d\n",dp->size);
+    if(i == NRANGELOCK && fr >= 0)
+      break;
+    sleep(&rangelocks, &rangelocks.lock);
+  }
+  rangelocks.r[fr].ip = ip;
+  rangelocks.r[fr].first = first;
+  rangelocks.r[fr].last = last;
+  release(&rangelocks.lock);
+  return fr;
+}
 
+static void
+irangeunlock(int slot)
+{
+  acquire(&rangelocks.lock);
+  rangelocks.r[slot].ip = 0;
+  wakeup(&rangelocks);
+  release(&rangelocks.lock);
+}
 
-        panic("tree_search");
-        }
-        //printf("in for loop and have red de\n");
-        if(!add)//查找模式下
-        {
-          if (namecmp(de->name,name)==0)
-          {
-            if (poff){
-              *poff = tree_node_off;
-              
-            }
-            // printf("find %s at offset %d\n",name,tree_node_off);
-            return;
-          }
-          // else if(tree_node_off<113*BSIZE){
-          //   printf("at %d is %s not %s\n",tree_node_off,de->name,name);
-          // }
-        }
-        else{// 新建模式下
-          if(de->inum==0)//是空的，可以用
-          {
-            
-            if (poff)
-              *poff = tree_node_off;
-            //printf("%d is empty can use\n",tree_node_off);
-            return;
-          }
-          // else{
-          //   printf("this is %s not empty\n",de->name);
-          // }
-        }
+// Overwrite n bytes of ip at off, all inside blocks the file
+// already has. Caller must hold ip->lock shared (or not
+// shared) and be inside a transaction. Returns -1, having
+// written nothing, if the write would have to change the
+// inode (grow the file, fill a hole, or change inline
+// data); the caller must then use writei() under ilock().
+// Otherwise returns the number of bytes written.
+int
+ioverwrite(struct inode *ip, int user_src, uint64 src, uint64 off, uint n)
+{
+  uint tot, m, bn, first, last;
+  struct buf *bp;
+  int slot;
+
+  if(n == 0 || off + n < off || off + n > ip->size || (ip->flags & I_INLINE))
+    return -1;
+  first = off / BSIZE;
+  last = (off + n - 1) / BSIZE;
+  for(bn = first; bn <= last; bn++)
+    if(bmap_lookup(ip, bn) == 0)
+      return -1;
+
+  slot = irangelock(ip, first, last);
+  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
+    bp = bread(ip->dev, bmap_lookup(ip, off/BSIZE));
+    m = min(n - tot, BSIZE - off%BSIZE);
+    if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
+      brelse(bp);
+      break;
     }
-    
-    // 在常规区域没有找到
-    // 到溢出区找
-    tree_node_off=113*BSIZE;
-    tree_next_node_off=115*BSIZE;//MAXFSIZE;
-    //printf("search in overflow area.\n");
-    for(;tree_node_off<tree_next_node_off;tree_node_off+=sizeof(struct dirent))
-    {
-        // 根据需要进行扩容，搜索的话不需要扩容，而新建的话需要扩容
-        if(tree_node_off>=dp->size){
-          if(add==1){
-            //debug
-            //printf("off %d, stop_off %d, pre_size %d\n",tree_node_off,tree_next_node_off,dp->size);
-            tree_expand(dp,tree_next_node_off-1);
-            //printf("now_size %d\n",dp->size);
-          }
-          else{
-            de->inum=0;
-            return;
-          }
-        }
-        
-        if (readi(dp, 0, (uint64)de, tree_node_off, sizeof(struct dirent)) != sizeof(struct dirent)){
-          if(add==1)
-          {
-            printf("in add file mode\n");
-          }
-          else{
-            printf("in find file mode\n");
-          }
-          printf("name:%s\n",name);
-          printf("hash_value:%d\n",hash_value);
-          //printf("lower_bound_block:%d\n",lower_bound_block);
-          //printf("tree_node_block:%d\n",tree_node_block);
-          printf("tree_node_off:%d\n",tree_node_off);
-          printf("dp->size:%d\n",dp->size);
+    log_write(bp);
+    brelse(bp);
+  }
+  irangeunlock(slot);
 
+  // idefrag() reads wseq under ilock(), so never while this runs.
+  if(tot > 0)
+    __sync_fetch_and_add(&ip->wseq, 1);
+  return tot;
+}
 
-        panic("tree_search");
-        }
-        //printf("in for loop and have red de\n");
-        if(!add)//查找模式下
-        {
-          if (namecmp(de->name,name)==0)
-          {
-            if (poff){
-              *poff = tree_node_off;
-              
-            }
-            //printf("find %s at offset %d\n",name,tree_node_off);
-            return;
-          }
-          // else{
-          //   printf("at %d is %s not %s\n",tree_node_off,de->name,name);
-          // }
-        }
-        else{// 新建模式下
-          if(de->inum==0)//是空的，可以用
-          {
-            if (poff)
-              *poff = tree_node_off;
-            return;
-          }
-          // else{
-          //   printf("this is %s not empty\n",de->name);
-          // }
-        }
+// Directories
+
+int
+namecmp(const char *s, const char *t)
+{
+  return strncmp(s, t, DIRSIZ);
+}
+
+// Hash Tree
+// Name hash for directory indexes, seeded per file system.
+uint
+namehash(char *name)
+{
+  return dx_hash(sb.hashseed, name);
+}
+
+// Hashed directories.
+//
+// A directory starts out as one block of dirents searched
+// linearly, so a small directory costs a single block. When
+// that block fills, its names move to a new leaf and block 0
+// becomes the root of an index keyed by name hash (see fs.h). The index has up to
+// DX_MAXLEVELS levels; its bottom entries point at leaf blocks
+// of plain dirents, each leaf holding the names of one hash
+// range. A full leaf splits at its median hash, a full index
+// node splits in half, and a full root moves its entries into
+// a new node and so adds a level. Names with equal hashes are
+// never split apart, so a lookup reads one leaf.
+
+// One level of a walk down the index.
+struct dx_frame {
+  struct buf *bp;
+  struct dx_head *hd;
+  struct dx_entry *ents;
+  int at;                      // entry followed at this level
+};
+
+struct dx_path {
+  struct dx_frame f[DX_MAXLEVELS];
+  int n;                       // frames in use; f[n-1] points at leaves
+};
+
+// Read directory block blk, which must exist.
+static struct buf*
+dx_bread(struct inode *dp, uint blk)
+{
+  uint addr;
+
+  if((addr = bmap_lookup(dp, blk)) == 0)
+    panic("dx_bread");
+  return bread(dp->dev, addr);
+}
+
+// Append a zeroed block to directory dp.
+static struct buf*
+dx_newblock(struct inode *dp, uint *blk)
+{
+  struct buf *bp;
+
+  *blk = dp->size / BSIZE;
+  bp = bread(dp->dev, bmap(dp, *blk));
+  dp->size += BSIZE;
+  iupdate(dp);
+  return bp;
+}
+
+static struct dx_head*
+dx_root(struct buf *bp)
+{
+  return (struct dx_head*)(bp->data + 2*sizeof(struct dirent));
+}
+
+// Index of the last entry of a node that may hold hash.
+static int
+dx_search(struct dx_head *hd, struct dx_entry *ents, uint hash)
+{
+  int lo = 1, hi = hd->count - 1, mid, r = 0;
+
+  while(lo <= hi){
+    mid = (lo + hi) / 2;
+    if(ents[mid].hash <= hash){
+      r = mid;
+      lo = mid + 1;
+    } else
+      hi = mid - 1;
+  }
+  return r;
+}
+
+// Walk from the root to the index node above the leaf for hash.
+static void
+dx_probe(struct inode *dp, uint hash, struct dx_path *p)
+{
+  struct dx_frame *f;
+  struct buf *bp;
+  struct dx_head *hd;
+  int l, levels;
+
+  bp = dx_bread(dp, 0);
+  hd = dx_root(bp);
+  if(hd->magic != DX_MAGIC || hd->levels >= DX_MAXLEVELS)
+    panic("dx_probe: bad root");
+  levels = hd->levels;
+  for(l = 0; ; l++){
+    f = &p->f[l];
+    f->bp = bp;
+    f->hd = hd;
+    f->ents = (struct dx_entry*)(hd + 1);
+    f->at = dx_search(hd, f->ents, hash);
+    if(l == levels)
+      break;
+    bp = dx_bread(dp, f->ents[f->at].block);
+    hd = (struct dx_head*)bp->data;
+    if(hd->magic != DX_MAGIC)
+      panic("dx_probe: bad node");
+  }
+  p->n = l + 1;
+}
+
+static void
+dx_release(struct dx_path *p)
+{
+  int l;
+
+  for(l = 0; l < p->n; l++)
+    brelse(p->f[l].bp);
+}
+
+// Leaf block that may hold hash.
+static uint
+dx_leaf(struct dx_path *p)
+{
+  struct dx_frame *f = &p->f[p->n - 1];
+
+  return f->ents[f->at].block;
+}
+
+// Insert the entry (hash, blk) just after the followed entry
+// of level l, making room by splitting nodes or growing the
+// root. The caller has checked there is room for it.
+static void
+dx_insert(struct inode *dp, struct dx_path *p, int l, uint hash, uint blk)
+{
+  struct dx_frame *f = &p->f[l], *r;
+  struct dx_head *nh;
+  struct dx_entry *ne;
+  struct buf *nbp;
+  uint nblk;
+  int half, i, n;
+
+  dp->dxgen++;  // entries move; see dirnext()
+  if(f->hd->count == f->hd->limit){
+    nbp = dx_newblock(dp, &nblk);
+    nh = (struct dx_head*)nbp->data;
+    ne = (struct dx_entry*)(nh + 1);
+    nh->magic = DX_MAGIC;
+    nh->limit = DX_NODE_LIMIT;
+    if(l == 0){
+      // Move the root's entries down into a new node.
+      r = &p->f[0];
+      nh->count = r->hd->count;
+      memmove(ne, r->ents, r->hd->count * sizeof(*ne));
+      r->hd->count = 1;
+      r->hd->levels++;
+      r->ents[0].hash = 0;
+      r->ents[0].block = nblk;
+      r->ents[0].count = 0;
+      log_write(r->bp);
+      for(i = p->n; i > 1; i--)
+        p->f[i] = p->f[i-1];
+      p->n++;
+      f = &p->f[1];
+      f->bp = nbp;
+      f->hd = nh;
+      f->ents = ne;
+      f->at = r->at;
+      r->at = 0;
+    } else {
+      // Move the upper half into a new node.
+      half = f->hd->count / 2;
+      nh->count = f->hd->count - half;
+      memmove(ne, f->ents + half, nh->count * sizeof(*ne));
+      f->hd->count = half;
+      log_write(f->bp);
+      log_write(nbp);
+      n = p->n;
+      dx_insert(dp, p, l - 1, ne[0].hash, nblk);
+      // growing the root pushes this level down one frame
+      l += p->n - n;
+      f = &p->f[l];
+      if(f->at >= half){
+        brelse(f->bp);
+        f->bp = nbp;
+        f->hd = nh;
+        f->ents = ne;
+        f->at -= half;
+        p->f[l-1].at++;
+      } else
+        brelse(nbp);
     }
-    
-    // //在溢出区内查找并且遍历了一遍溢出区，没有返回，说明溢出区满了
-    // if(tree_next_node_off==MAXFSIZE){
-    //   if(add)
-    //     printf("overflow area is full\n");
-    //   break;
-    // }
-    
-  //}
-  de->inum=0;//查找失败
-  
+  }
+
+  memmove(f->ents + f->at + 2, f->ents + f->at + 1,
+          (f->hd->count - f->at - 1) * sizeof(struct dx_entry));
+  f->ents[f->at + 1].hash = hash;
+  f->ents[f->at + 1].block = blk;
+  f->ents[f->at + 1].count = 0;
+  f->hd->count++;
+  log_write(f->bp);
+}
+
+// Index the full single-block directory dp: move every name
+// but "." and ".." to a new leaf and turn the rest of block 0
+// into an index root pointing at it.
+static void
+dx_make_index(struct inode *dp)
+{
+  struct buf *bp, *lbp;
+  struct dx_head *hd;
+  struct dx_entry *ents;
+  struct dirent *de;
+  uint blk, n;
+  int i, names;
+
+  n = 2*sizeof(struct dirent);
+  bp = dx_bread(dp, 0);
+  dp->flags |= I_INDEX;
+  dp->dxgen++;
+  lbp = dx_newblock(dp, &blk);
+  memmove(lbp->data, bp->data + n, BSIZE - n);
+  memset(bp->data + n, 0, BSIZE - n);
+  de = (struct dirent*)lbp->data;
+  for(i = names = 0; i < DX_LEAF_ENTS; i++)
+    if(de[i].inum != 0)
+      names++;
+  hd = dx_root(bp);
+  hd->magic = DX_MAGIC;
+  hd->limit = DX_ROOT_LIMIT;
+  hd->count = 1;
+  hd->names = names;
+  ents = (struct dx_entry*)(hd + 1);
+  ents[0].block = blk;
+  ents[0].count = names;
+  log_write(bp);
+  log_write(lbp);
+  brelse(lbp);
+  brelse(bp);
 }
 
+// Count a name added to (n 1) or removed from (n -1) the leaf
+// that path p leads to.
+static void
+dx_count(struct dx_path *p, int n)
+{
+  struct dx_frame *f = &p->f[p->n - 1];
+
+  f->ents[f->at].count += n;
+  log_write(f->bp);
+  p->f[0].hd->names += n;
+  log_write(p->f[0].bp);
+}
 
-void tree_add(struct inode* dp, char* name)
+// Can the index take one more leaf below path p?
+static int
+dx_hasroom(struct dx_path *p)
 {
+  int l;
 
+  for(l = p->n - 1; l >= 0; l--)
+    if(p->f[l].hd->count < p->f[l].hd->limit)
+      return 1;
+  return p->n < DX_MAXLEVELS;
 }
 
+// Split the full leaf bp, moving the names whose hash is at or
+// above the median to a new leaf. Returns the leaf that hash
+// now belongs in (the other is released), or 0 if the leaf
+// cannot be split. The bottom frame of p is left following
+// the returned leaf's entry.
+static struct buf*
+dx_split(struct inode *dp, struct dx_path *p, struct buf *bp, uint hash)
+{
+  struct dirent *de, *nde;
+  struct dx_frame *f;
+  struct buf *nbp;
+  uint hs[DX_LEAF_ENTS], m, t, nblk;
+  int i, j, k;
+
+  de = (struct dirent*)bp->data;
+  for(i = 0; i < DX_LEAF_ENTS; i++){
+    t = namehash(de[i].name);
+    for(j = i; j > 0 && hs[j-1] > t; j--)
+      hs[j] = hs[j-1];
+    hs[j] = t;
+  }
+  // Split at the median, or above it if the lower half is all
+  // one hash.
+  for(k = DX_LEAF_ENTS / 2; k < DX_LEAF_ENTS && hs[k] == hs[0]; k++)
+    ;
+  if(k == DX_LEAF_ENTS || !dx_hasroom(p))
+    return 0;
+  m = hs[k];
+
+  nbp = dx_newblock(dp, &nblk);
+  nde = (struct dirent*)nbp->data;
+  for(i = j = 0; i < DX_LEAF_ENTS; i++){
+    if(namehash(de[i].name) >= m){
+      nde[j++] = de[i];
+      memset(&de[i], 0, sizeof(de[i]));
+    }
+  }
+  log_write(bp);
+  log_write(nbp);
+  dx_insert(dp, p, p->n - 1, m, nblk);
+  f = &p->f[p->n - 1];
+  f->ents[f->at].count = DX_LEAF_ENTS - j;
+  f->ents[f->at + 1].count = j;
+  log_write(f->bp);
+  if(hash >= m){
+    f->at++;
+    brelse(bp);
+    return nbp;
+  }
+  brelse(nbp);
+  return bp;
+}
 
+// Scan, in place, the one block of dp that can hold name: the
+// leaf its hash selects, or block 0 for "." and ".." and in a
+// directory without an index. Returns that block locked, with
+// *blk its number, *at the slot holding name or -1, and *fr the
+// first free slot before it or -1. The index path to the leaf is
+// left in p for dirlink(); release it with dx_release(). If p
+// is 0 the index is released before the leaf is read, so only
+// the leaf stays locked.
+static struct buf*
+dirscan(struct inode *dp, char *name, struct dx_path *p, uint *blk, int *at, int *fr)
+{
+  struct dx_path path;
+  struct dirent *e;
+  struct buf *bp;
+  int i, n;
+
+  n = DX_LEAF_ENTS;
+  if(p)
+    p->n = 0;
+  if(!(dp->flags & I_INDEX))
+    *blk = 0;
+  else if(namecmp(name, ".") == 0 || namecmp(name, "..") == 0){
+    // "."或者".."直接查找前两个。
+    *blk = 0;
+    n = 2;
+  } else if(p == 0){
+    dx_probe(dp, namehash(name), &path);
+    *blk = dx_leaf(&path);
+    dx_release(&path);
+  } else {
+    dx_probe(dp, namehash(name), p);
+    *blk = dx_leaf(p);
+  }
+
+  bp = dx_bread(dp, *blk);
+  e = (struct dirent*)bp->data;
+  *at = *fr = -1;
+  for(i = 0; i < n; i++){
+    if(e[i].inum == 0){
+      if(*fr < 0)
+        *fr = i;
+    } else if(namecmp(name, e[i].name) == 0){
+      *at = i;
+      break;
+    }
+  }
+  return bp;
+}
 
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
-  struct dirent de;
+  uint inum, blk;
+  struct buf *bp;
+  int at, fr;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
-  if(namecmp(name,".")!=0&&namecmp(name,"..")!=0)
-  {
-    
-    tree_search(dp,name,poff,&de,0);
-    if(de.inum)
-    {
-      return iget(dp->dev,de.inum);
-    }
-    //panic("done 770:not found");
+  // The cache does not know offsets, so unlink reads the directory.
+  if(poff == 0 && dcache_lookup(dp, name, &inum))
+    return inum ? iget(dp->dev, inum) : 0;
+
+  bp = dirscan(dp, name, 0, &blk, &at, &fr);
+  inum = at < 0 ? 0 : ((struct dirent*)bp->data)[at].inum;
+  // Still holding the block, as dirlinkshared() does, so that
+  // the cache cannot end up behind a concurrent link.
+  dcache_enter(dp, name, inum);
+  brelse(bp);
+
+  if(inum == 0)
+    return 0;
+  if(poff)
+    *poff = blk*BSIZE + at*sizeof(struct dirent);
+  return iget(dp->dev, inum);
+}
+
+// Write a new directory entry (name, inum) into the directory dp.
+// Returns -1 if the name exists or the directory is full.
+// Checking for the name and finding a free slot are one scan.
+int
+dirlink(struct inode *dp, char *name, uint inum)
+{
+  struct dx_path p;
+  struct buf *bp, *nbp;
+  struct dirent *e;
+  uint blk;
+  int at, fr;
+
+  bp = dirscan(dp, name, &p, &blk, &at, &fr);
+  if(at >= 0){
+    brelse(bp);
+    dx_release(&p);
+    return -1;
   }
-  else{
-    // "."或者".."直接线性查找前两个。
-  for(off = 0; off < 2*sizeof(de); off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlookup read");
-    if(de.inum == 0)
-      continue;
-    if(namecmp(name, de.name) == 0){
-      // entry matches path element
-      if(poff)
-        *poff = off;
-      inum = de.inum;
-      return iget(dp->dev, inum);
-    }
+  if(fr < 0 && !(dp->flags & I_INDEX)){
+    // The single block is full: index it and look again.
+    brelse(bp);
+    dx_make_index(dp);
+    bp = dirscan(dp, name, &p, &blk, &at, &fr);
   }
-  //panic("done 787");
+
+  while(fr < 0){
+    if((nbp = dx_split(dp, &p, bp, namehash(name))) == 0){
+      brelse(bp);
+      dx_release(&p);
+      return -1;
+    }
+    bp = nbp;
+    e = (struct dirent*)bp->data;
+    for(fr = 0; fr < DX_LEAF_ENTS && e[fr].inum != 0; fr++)
+      ;
+    if(fr == DX_LEAF_ENTS)
+      fr = -1;
   }
 
+  e = (struct dirent*)bp->data;
+  memset(&e[fr], 0, sizeof(e[fr]));
+  strncpy(e[fr].name, name, DIRSIZ);
+  e[fr].inum = inum;
+  log_write(bp);
+  dcache_enter(dp, name, inum);
+  brelse(bp);
+  if(p.n > 0)
+    dx_count(&p, 1);
+  dx_release(&p);
   return 0;
 }
 
-// Write a new directory entry (name, inum) into the directory dp.
+// Link name to inum as dirlink() does, for a caller that holds
+// dp only shared. The name goes into a free slot of the block
+// dirscan() picks for it, with only that block's buffer locked,
+// so links into other leaves of dp go on at the same time.
+// Returns -1 if the name exists or the block is full: making
+// room changes the index and dp, so the caller must then lock
+// dp with ilock() and use dirlink().
 int
-dirlink(struct inode *dp, char *name, uint inum)
+dirlinkshared(struct inode *dp, char *name, uint inum)
 {
-  uint off=0;
-  struct dirent de;
-  struct inode *ip;
+  struct dx_path p;
+  struct buf *bp;
+  struct dirent *e;
+  uint blk;
+  int at, fr;
 
-  // Check that name is not present.
-  if((ip = dirlookup(dp, name, 0)) != 0){
-    iput(ip);
+  bp = dirscan(dp, name, 0, &blk, &at, &fr);
+  if(at >= 0 || fr < 0){
+    brelse(bp);
     return -1;
   }
+  e = (struct dirent*)bp->data;
+  memset(&e[fr], 0, sizeof(e[fr]));
+  strncpy(e[fr].name, name, DIRSIZ);
+  e[fr].inum = inum;
+  log_write(bp);
+  dcache_enter(dp, name, inum);
+  brelse(bp);
 
-  // Look for an empty dirent.
-  tree_search(dp,name,&off,&de,1);
-  // printf("create file %s\n",name);
-  
-  // for(off = 0; off < dp->size; off += sizeof(de)){
-  //   if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-  //     panic("dirlink read");
-  //   if(de.inum == 0)
-  //     break;
-  // }
-
-  strncpy(de.name, name, DIRSIZ);
-  de.inum = inum;
-  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-    panic("dirlink");
-
+  // The index cannot change while dp is held shared, so the
+  // path found again leads to the same leaf. The leaf is
+  // released first: dx_probe() locks from the root down.
+  if((dp->flags & I_INDEX) && blk != 0){
+    dx_probe(dp, namehash(name), &p);
+    if(dx_leaf(&p) != blk)
+      panic("dirlinkshared: leaf");
+    dx_count(&p, 1);
+    dx_release(&p);
+  }
   return 0;
 }
 
-// Look for a directory entry in a directory.
-// If found, set *poff to byte offset of entry.
-struct inode*
-dirlookup_old(struct inode *dp, char *name, uint *poff)
+// Is the directory dp empty except for "." and ".." ?
+// An indexed directory keeps count of its names.
+int
+dirempty(struct inode *dp)
 {
-  uint off, inum;
-  struct dirent de;
-
-  if(dp->type != T_DIR)
-    panic("dirlookup not DIR");
+  struct dirent *e;
+  struct buf *bp;
+  int i, empty;
+
+  bp = dx_bread(dp, 0);
+  if(dp->flags & I_INDEX)
+    empty = dx_root(bp)->names == 0;
+  else {
+    e = (struct dirent*)bp->data;
+    for(i = 2; i < DX_LEAF_ENTS && e[i].inum == 0; i++)
+      ;
+    empty = i == DX_LEAF_ENTS;
+  }
+  brelse(bp);
+  return empty;
+}
 
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlookup read");
-    if(de.inum == 0)
+// Point c at the index entry for leaf blk of dp, searching the
+// whole index. Returns 0 if no entry names blk.
+static int
+dx_seek(struct inode *dp, uint blk, struct dircursor *c)
+{
+  struct buf *bp[DX_MAXLEVELS];
+  struct dx_head *hd[DX_MAXLEVELS];
+  struct dx_entry *e;
+  int l, levels;
+
+  bp[0] = dx_bread(dp, 0);
+  hd[0] = dx_root(bp[0]);
+  levels = hd[0]->levels;
+  c->at[0] = 0;
+  l = 0;
+  while(l >= 0){
+    if(c->at[l] == hd[l]->count){
+      brelse(bp[l--]);
+      if(l >= 0)
+        c->at[l]++;
       continue;
-    if(namecmp(name, de.name) == 0){
-      // entry matches path element
-      if(poff)
-        *poff = off;
-      inum = de.inum;
-      return iget(dp->dev, inum);
     }
+    e = (struct dx_entry*)(hd[l] + 1) + c->at[l];
+    if(l < levels){
+      l++;
+      bp[l] = dx_bread(dp, e->block);
+      hd[l] = (struct dx_head*)bp[l]->data;
+      c->at[l] = 0;
+    } else if(e->block == blk){
+      while(l >= 0)
+        brelse(bp[l--]);
+      return 1;
+    } else
+      c->at[l]++;
   }
-
   return 0;
 }
 
-// // Write a new directory entry (name, inum) into the directory dp.
-// int dirlink(struct inode *dp, char *name, uint inum)
-// {
-//   int off;
-//   struct dirent de;
-//   struct inode *ip;
-
-//   // Check that name is not present.
-//   if ((ip = dirlookup(dp, name, 0)) != 0)
-//   {
-//     iput(ip);
-//     return -1;
-//   }
+// Move c to the next leaf of dp that holds names, or to the
+// first such leaf if first is set, reading one block per level.
+// Returns its block number, or 0 at the end of the index.
+static uint
+dx_step(struct inode *dp, struct dircursor *c, int first)
+{
+  struct buf *bp[DX_MAXLEVELS];
+  struct dx_head *hd[DX_MAXLEVELS];
+  struct dx_entry *e;
+  int l, levels;
+  uint blk;
+
+  bp[0] = dx_bread(dp, 0);
+  hd[0] = dx_root(bp[0]);
+  levels = hd[0]->levels;
+  if(first)
+    memset(c->at, 0, sizeof(c->at));
+  // Read the nodes above the current leaf.
+  for(l = 0; l < levels; l++){
+    e = (struct dx_entry*)(hd[l] + 1) + c->at[l];
+    bp[l+1] = dx_bread(dp, e->block);
+    hd[l+1] = (struct dx_head*)bp[l+1]->data;
+  }
+  if(!first)
+    c->at[levels]++;
+
+  blk = 0;
+  while(l >= 0){
+    if(c->at[l] >= hd[l]->count){
+      brelse(bp[l--]);
+      if(l >= 0)
+        c->at[l]++;
+      continue;
+    }
+    e = (struct dx_entry*)(hd[l] + 1) + c->at[l];
+    if(l < levels){
+      l++;
+      bp[l] = dx_bread(dp, e->block);
+      hd[l] = (struct dx_head*)bp[l]->data;
+      c->at[l] = 0;
+    } else if(e->count > 0){
+      blk = e->block;
+      while(l >= 0)
+        brelse(bp[l--]);
+    } else
+      c->at[l]++;
+  }
+  return blk;
+}
 
-//   // Look for an empty dirent.
-//   for(off = 0; off < dp->size; off += sizeof(de)){
-//     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-//       panic("dirlink read");
-//     if(de.inum == 0)
-//       break;
-//   }
+// Read the next name of dp at or after byte offset *off into
+// de and advance *off past it. Returns 0 at the end of the
+// directory. An indexed directory is listed "." and ".." first,
+// then leaf by leaf in index order, skipping empty leaves; c
+// keeps the leaf's place in the index so that moving on to the
+// next leaf reads only the nodes above it. If the index has
+// changed since, or *off was moved, the place is found again.
+int
+dirnext(struct inode *dp, uint64 *off, struct dircursor *c, struct dirent *de)
+{
+  struct dirent *e;
+  struct buf *bp;
+  uint blk;
+  int i, n, index;
+
+  index = dp->flags & I_INDEX;
+  for(;;){
+    if(index && c->off == *off){
+      blk = c->blk;  // *off may be just past its last name
+      if(c->gen != dp->dxgen){
+        if(blk != 0 && !dx_seek(dp, blk, c))
+          break;
+        c->gen = dp->dxgen;
+      }
+    } else {
+      if(*off >= dp->size)
+        break;
+      blk = *off / BSIZE;
+      if(index && blk != 0){
+        if(!dx_seek(dp, blk, c))
+          break;
+        c->gen = dp->dxgen;
+      }
+      c->blk = blk;
+    }
+    // only "." and ".." in block 0 of an indexed directory
+    n = blk == 0 && index ? 2 : DX_LEAF_ENTS;
+    i = (*off - (uint64)blk*BSIZE) / sizeof(*e);
+    if(i < n){
+      bp = dx_bread(dp, blk);
+      e = (struct dirent*)bp->data;
+      for(; i < n && e[i].inum == 0; i++)
+        ;
+      if(i < n)
+        *de = e[i];
+      brelse(bp);
+      if(i < n){
+        *off = (uint64)blk*BSIZE + (i + 1)*sizeof(*e);
+        c->off = *off;
+        return 1;
+      }
+    }
+    if(!index){
+      *off = (uint64)(blk + 1) * BSIZE;
+      continue;
+    }
+    if((blk = dx_step(dp, c, blk == 0)) == 0)
+      break;
+    *off = (uint64)blk * BSIZE;
+    c->off = *off;
+    c->blk = blk;
+    c->gen = dp->dxgen;
+  }
+  *off = dp->size;
+  return 0;
+}
 
-//   strncpy(de.name, name, DIRSIZ);
-//   de.inum = inum;
-//   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-//     panic("dirlink");
+// The lock for the hash bucket of name in directory dp. Holding
+// it keeps name from being linked into dp by anyone else, so
+// create() can check that the name is free, allocate the inode
+// and link it with dp locked only for the directory search and
+// update, and then only shared unless the name's leaf is full;
+// creates of names in other buckets run in between.
+// Take it before locking dp.
+struct sleeplock*
+dirnamelock(struct inode *dp, char *name)
+{
+  return &namelocks[(namehash(name) ^ dp->inum) % NNAMELOCK];
+}
 
-//   return 0;
-// }
-// */
+// Remove the entry for name, which dirlookup found at off,
+// from the directory dp.
+void
+dirunlink(struct inode *dp, char *name, uint off)
+{
+  struct dx_path p;
+  struct buf *bp;
 
+  bp = dx_bread(dp, off / BSIZE);
+  memset(bp->data + off % BSIZE, 0, sizeof(struct dirent));
+  log_write(bp);
+  brelse(bp);
+  if((dp->flags & I_INDEX) && off >= BSIZE){
+    dx_probe(dp, namehash(name), &p);
+    if(dx_leaf(&p) != off / BSIZE)
+      panic("dirunlink: leaf");
+    dx_count(&p, -1);
+    dx_release(&p);
+  }
+  dcache_enter(dp, name, 0);
+}
 
 // 初始化目录
+// A new directory is one block holding "." and "..".
 void build_dir_tree(struct inode* dp,uint pinum)
 {
-  dp->size=2*sizeof(struct dirent);
-  iupdate(dp);
+  struct buf *bp;
+  struct dirent *de;
+  uint blk;
 
-  struct dirent de;
+  // forget names cached while this inode was another directory
+  dcache_purge(dp->dev, dp->inum);
+  bp = dx_newblock(dp, &blk);
+  de = (struct dirent*)bp->data;
   //写入"."
-  if (readi(dp, 0, (uint64)&de, 0, sizeof(struct dirent)) != sizeof(struct dirent))
-      panic("dirinit read");
-  strncpy(de.name,".",DIRSIZ);
-  de.inum=dp->inum;
-  if (writei(dp, 0, (uint64)&de, 0, sizeof(de)) != sizeof(de))
-      panic("dirinit write");
-  
+  de[0].inum = dp->inum;
+  strncpy(de[0].name, ".", DIRSIZ);
   //写入".."
-  if (readi(dp, 0, (uint64)&de, sizeof(de), sizeof(struct dirent)) != sizeof(struct dirent))
-      panic("dirinit read");
-  strncpy(de.name,"..",DIRSIZ);
-  de.inum=pinum;
-  if (writei(dp, 0, (uint64)&de, sizeof(de), sizeof(de)) != sizeof(de))
-      panic("dirinit write");
-
+  de[1].inum = pinum;
+  strncpy(de[1].name, "..", DIRSIZ);
+  log_write(bp);
+  brelse(bp);
 }
 
 
-
 // Paths
 
 // Copy the next path element from path into name.
@@ -1457,15 +2980,73 @@ skipelem(char *path, char *name)
   return path;
 }
 
+// Resolve path from the dentry cache alone, passing through
+// directories by inode number without locking or referencing
+// them. Returns 1 with *ipp set (0 if the path is known not to
+// exist), or 0 if the cache cannot say for sure and the caller
+// must take the locked walk. A hit in the cache also proves
+// that the inode searched is a directory, since only those
+// have entries.
+
+// Components namefast() will follow; longer paths take namex().
+#define NFASTELEM 8
+
+static int
+namefast(char *path, struct inode **ipp)
+{
+  char name[NFASTELEM][DIRSIZ];
+  uint dinum[NFASTELEM], seq[NFASTELEM];
+  struct inode *ip;
+  uint dev, inum;
+  int n, i;
+
+  if (*path == '/') {
+    dev = ROOTDEV;
+    inum = ROOTINO;
+  } else {
+    dev = myproc()->cwd->dev;
+    inum = myproc()->cwd->inum;
+  }
+  for (n = 0; ; n++) {
+    if (n == NFASTELEM)
+      return 0;
+    if ((path = skipelem(path, name[n])) == 0)
+      break;
+    dinum[n] = inum;
+    if (!dcache_peek(dev, dinum[n], name[n], &inum, &seq[n]))
+      return 0;
+    if (inum == 0) {
+      n++;
+      break;
+    }
+  }
+  ip = inum ? iget(dev, inum) : 0;
+  // Every entry followed must still hold, so that they all held
+  // at once, and now that ip is referenced it cannot be freed.
+  for (i = 0; i < n; i++) {
+    if (!dcache_valid(dev, dinum[i], name[i], seq[i])) {
+      if (ip)
+        iputlazy(ip);
+      return 0;
+    }
+  }
+  *ipp = ip;
+  return 1;
+}
+
 // Look up and return the inode for a path name.
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
-// Must be called inside a transaction since it calls iput().
+// Need not be called inside a transaction: the inodes it lets
+// go of are put with iputlazy().
 static struct inode *
 namex(char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
 
+  if (!nameiparent && namefast(path, &ip))
+    return ip;
+
   if (*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
   else
@@ -1473,29 +3054,32 @@ namex(char *path, int nameiparent, char *name)
 
   while ((path = skipelem(path, name)) != 0)
   {
-    ilock(ip);
+    ilockshared(ip);
     if (ip->type != T_DIR)
     {
-      iunlockput(ip);
+      iunlockshared(ip);
+      iputlazy(ip);
       return 0;
     }
     if (nameiparent && *path == '\0')
     {
       // Stop one level early.
-      iunlock(ip);
+      iunlockshared(ip);
       return ip;
     }
     if ((next = dirlookup(ip, name, 0)) == 0)
     {
-      iunlockput(ip);
+      iunlockshared(ip);
+      iputlazy(ip);
       return 0;
     }
-    iunlockput(ip);
+    iunlockshared(ip);
+    iputlazy(ip);
     ip = next;
   }
   if (nameiparent)
   {
-    iput(ip);
+    iputlazy(ip);
     return 0;
   }
   return ip;
@@ -1524,11 +3108,9 @@ divesymlink(struct inode *isym)
     int deep = 0;
 
     do {
-        // get linked target
-        // we don't know how long the file str is, so we expect once read could get fullpath.
+        // get linked target; its length is the file size
         len = readi(ip, 0, (uint64)path, 0, MAXPATH);
-        if (readi(ip, 0, (uint64)(path + len), len, MAXPATH + 1) != 0)
-            panic("divesymlink : short read");    
+        path[len] = 0;
 
         iunlockput(ip);
         if (++deep > 10) {  // may cycle link
@@ -28,6 +28,8 @@ struct superblock {
   uint ibmapstart;
   uint freeinodes;
   uint freeblocks;
+  uint orphan;       // First inode on the orphan list, or 0
+  uint hashseed;     // Seed of the directory name hash
 };
 
 extern struct superblock sb;
@@ -41,6 +43,10 @@ extern struct superblock sb;
 // #define MAXFILE (NDIRECT + NINDIRECT + NINDIRECT * NINDIRECT)
 #define MAXFILE   (NDIRECT + NINDIRECT + NINDIRECT * NINDIRECT + NINDIRECT * NINDIRECT * NINDIRECT)
 
+// Bytes of file data that fit in the inode itself: whatever
+// of the 128-byte dinode the other fields leave over.
+#define IDATASIZE 92
+
 // On-disk inode structure
 struct dinode
 {
@@ -48,16 +54,57 @@ struct dinode
   short major; // Major device number (T_DEVICE only)
   short minor; // Minor device number (T_DEVICE only)
   short nlink; // Number of links to inode in file system
-  uint size;   // Size of file (bytes)
+  uint64 size; // Size of file (bytes)
 
   // new
   uint rwmode;    // 读写权限，00不能读不能写，01不能读可以写，10可读不能写，11能读能写（default）
   uint supermode; //是否是高级文件
-  uint addrs[NDIRECT + 3];
   uint showmode; //是否显示
-  uchar useless[41];
+  uint flags;     // I_* bits
+  uint orphan;    // next inode on the orphan list (I_ORPHAN only)
+  union {
+    uint addrs[NDIRECT + 3];  // Data block addresses
+    char data[IDATASIZE];     // or the data itself (I_INLINE)
+  };
+};
+
+// Inode flags
+#define I_ORPHAN 0x1  // unlinked, blocks being freed by the reclaimer
+#define I_INLINE 0x2  // contents stored in the inode's data[]
+#define I_INDEX  0x4  // directory has a hash index (see fs.c)
+
+// Extent tree of a T_EXTENT file, laid out like ext4's.
+// The root node lives in the inode's addrs[] (a header plus
+// EXT_ROOT_ENTRIES entries); deeper nodes fill a whole block.
+// Entries of a node are sorted by lblk. Nodes with depth 0 hold
+// struct extent leaves, the others struct extent_idx pointing
+// at the child node that covers blocks from lblk onwards.
+#define EXT_MAGIC 0xF30A
+#define EXT_MAXDEPTH 5
+
+struct extent_header {
+  ushort magic;   // EXT_MAGIC
+  ushort entries; // number of valid entries
+  ushort max;     // capacity of this node
+  ushort depth;   // 0 for leaves
+  uint unused;
+};
+
+struct extent {
+  uint lblk;      // first logical block covered
+  uint len;       // number of blocks
+  uint pblk;      // first physical block
+};
+
+struct extent_idx {
+  uint lblk;      // first logical block covered by child
+  uint child;     // block number of the child node
+  uint unused;
 };
 
+#define EXT_ROOT_ENTRIES ((sizeof(uint)*(NDIRECT+3) - sizeof(struct extent_header)) / sizeof(struct extent))
+#define EXT_BLOCK_ENTRIES ((BSIZE - sizeof(struct extent_header)) / sizeof(struct extent))
+
 // Inodes per block.
 #define IPB (BSIZE / sizeof(struct dinode))
 
@@ -81,11 +128,58 @@ struct dirent {
   char name[DIRSIZ];
 };
 
-#define DIRENT_NUM 7168
-#define FIRST_LAYER_NODE_NUM 112
-#define OVERFLOW_BLOCK FIRST_LAYER_NODE_NUM+1
-//#define OVERFLOW_DIRENT_NUM  704//((17148-64)/64-256)*64=11*64
-#define NUM_DIRENT_PER_BLOCK BSIZE/sizeof(struct dirent)
-#define SECOND_LAYER_NODE_NUM NUM_DIRENT_PER_BLOCK
-#define HASHRANGE 443 // 0x1BB //0x6FD // 1789
-#define MAXFSIZE (119 * BSIZE)
+// Hash of a directory entry name, which orders the names in a
+// directory's index. FNV-1a started from the file system's
+// seed, then murmur3's final mix so that names differing in
+// one character land far apart. Used by the kernel and mkfs.
+static inline uint
+dx_hash(uint seed, const char *name)
+{
+  uint h = 2166136261U ^ seed;
+  int i;
+
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619U;
+  h ^= h >> 16;
+  h *= 0x85ebca6bU;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35U;
+  h ^= h >> 16;
+  return h;
+}
+
+// Hash index of a directory (see fs.c). A new directory is a
+// single block of dirents; once that fills it gets I_INDEX and
+// is laid out as follows. Block 0 holds ".",
+// "..", then a dx_head and DX_ROOT_LIMIT dx_entrys; an index
+// node block holds a dx_head and DX_NODE_LIMIT dx_entrys, and
+// a leaf block holds DX_LEAF_ENTS dirents. Index headers and
+// entries are dirent-sized and begin with a zero inum, so a
+// scan of the directory as an array of dirents skips them.
+// The index also counts the names in each leaf and in the whole
+// directory, so scans can skip empty leaves and an emptiness
+// check needs no scan at all.
+#define DX_MAGIC 0xD1
+#define DX_MAXLEVELS 3   // root plus two levels of index nodes
+
+struct dx_head {
+  ushort zero;     // 0, an empty dirent to linear scans
+  uchar levels;    // root: index levels below the root
+  uchar magic;     // DX_MAGIC
+  ushort count;    // entries in use
+  ushort limit;    // entries that fit in the block
+  uint names;      // root: names in the directory but "." and ".."
+  uint spare;
+};
+
+struct dx_entry {
+  ushort zero;     // 0, an empty dirent to linear scans
+  ushort count;    // bottom level: names in the leaf
+  uint hash;       // lowest name hash below this entry
+  uint block;      // child block number within the directory
+  uint spare2;
+};
+
+#define DX_ROOT_LIMIT ((BSIZE - 2*sizeof(struct dirent) - sizeof(struct dx_head)) / sizeof(struct dx_entry))
+#define DX_NODE_LIMIT ((BSIZE - sizeof(struct dx_head)) / sizeof(struct dx_entry))
+#define DX_LEAF_ENTS (BSIZE / sizeof(struct dirent))
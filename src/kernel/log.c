@@ -141,6 +141,21 @@ begin_op(void)
   }
 }
 
+// Called between the operations of a batch that runs several
+// of them under one begin_op(). Returns 1 if the transaction
+// still has room for one more operation of up to MAXOPBLOCKS
+// blocks; if not, the caller should end_op() and begin_op().
+int
+log_hasroom(void)
+{
+  int room;
+
+  acquire(&log.lock);
+  room = log.lh.n + log.outstanding*MAXOPBLOCKS <= LOGSIZE;
+  release(&log.lock);
+  return room;
+}
+
 // called at the end of each FS system call.
 // commits if this was the last outstanding operation.
 void
@@ -193,6 +208,7 @@ write_log(void)
 static void
 commit()
 {
+  iflush();        // Copy dirty inodes into their logged blocks
   if (log.lh.n > 0) {
     write_log();     // Write modified blocks from cache to log
     write_head();    // Write header to disk -- the real commit
@@ -2,7 +2,10 @@
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // fewest in-memory i-nodes, in use or cached
+#define IMEMSHARE   128  // i-node cache gets 1/IMEMSHARE of free memory
+#define NDENTRY     128  // fewest cached directory entries
+#define DMEMSHARE   256  // dentry cache gets 1/DMEMSHARE of free memory
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
@@ -6,6 +6,7 @@
 #include "proc.h"
 #include "defs.h"
 #include "sleeplock.h"
+#include "fs.h"
 #include "file.h"
 
 struct cpu cpus[NCPU];
@@ -255,6 +256,34 @@ void userinit(void)
   release(&p->lock);
 }
 
+// A kernel process's very first scheduling by scheduler()
+// will swtch to kprocret.
+static void
+kprocret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+  p->kfn();
+  panic("kproc returned");
+}
+
+// Start a kernel process that runs fn() and never returns
+// to user space. Used for file system housekeeping.
+void kproc(void (*fn)(void), char *name)
+{
+  struct proc *p;
+
+  if ((p = allocproc()) == 0)
+    panic("kproc");
+  p->kfn = fn;
+  p->context.ra = (uint64)kprocret;
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->state = RUNNABLE;
+  release(&p->lock);
+}
+
 // Grow or shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
 int growproc(int n)
@@ -367,9 +396,7 @@ void exit(int status)
     }
   }
 
-  begin_op();
-  iput(p->cwd);
-  end_op();
+  iputlazy(p->cwd);
   p->cwd = 0;
 
   acquire(&wait_lock);
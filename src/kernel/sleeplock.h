@@ -2,6 +2,8 @@
 struct sleeplock {
   uint locked;       // Is the lock held?
   struct spinlock lk; // spinlock protecting this sleep lock
+  int readers;       // Number of shared holders
+  int wwait;         // Number waiting to lock it exclusively
   
   // For debugging:
   char *name;        // Name of lock.
@@ -14,5 +14,39 @@ struct stat {
   uint rwmode; //读写权限
   uint supermode; //是否是高级文件
   uint showmode; //是否显示
-  uint addrs[13]; // new
+  uint addrs[15]; // new, copy of addrs[NDIRECT+3]
+};
+
+// new, filled in by getdents(), one per directory entry
+struct direntplus {
+  uint ino;       // Inode number
+  short type;     // Type of file
+  short nlink;    // Number of links to file
+  uint64 size;    // Size of file in bytes
+  uint rwmode;
+  uint supermode;
+  uint showmode;
+  char name[16];  // DIRSIZ bytes and a NUL
+};
+
+// new, one operation of fsbatch()
+#define FSOP_CREATE  1  // create an empty file at path
+#define FSOP_MKDIR   2
+#define FSOP_UNLINK  3
+#define FSOP_SYMLINK 4  // make path a link to target
+#define FSOP_SETRW   5  // set rwmode of path to mode
+#define FSOP_SETSHOW 6  // set showmode of path to mode
+
+struct fsop {
+  int op;         // FSOP_*
+  int mode;
+  char *path;
+  char *target;
+  int status;     // set by fsbatch(): 0, or -1 if the op failed
+};
+
+// new, filled in by defrag()
+struct defragstat {
+  int before;  // extents before defragmenting
+  int after;   // extents after
 };
@@ -115,6 +115,11 @@ extern uint64 sys_showstat(void);
 extern uint64 sys_delete(void);
 extern uint64 sys_show(void);
 extern uint64 sys_lseek(void);
+extern uint64 sys_defrag(void);
+extern uint64 sys_getdents(void);
+extern uint64 sys_fsbatch(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -146,7 +151,12 @@ static uint64 (*syscalls[])(void) = {
 [SYS_showstat] sys_showstat,
 [SYS_delete]   sys_delete,
 [SYS_show]    sys_show,
-[SYS_lseek]   sys_lseek
+[SYS_lseek]   sys_lseek,
+[SYS_defrag]  sys_defrag,
+[SYS_getdents] sys_getdents,
+[SYS_fsbatch] sys_fsbatch,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
 };
 
 void
@@ -31,3 +31,8 @@
 #define SYS_delete 28
 #define SYS_show 29
 #define SYS_lseek  30
+#define SYS_defrag 31
+#define SYS_getdents 32
+#define SYS_fsbatch 33
+#define SYS_pread 34
+#define SYS_pwrite 35
@@ -93,6 +93,35 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// new
+// pread(fd, buf, n, off) and pwrite(fd, buf, n, off): read or
+// write at a given offset, in one call and without moving
+// the file offset. off is a full 64-bit register, as for
+// lseek().
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  int n;
+  uint64 p, off;
+
+  if (argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0 || argaddr(3, &off) < 0)
+    return -1;
+  return filepread(f, p, n, off);
+}
+
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  int n;
+  uint64 p, off;
+
+  if (argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &n) < 0 || argaddr(3, &off) < 0)
+    return -1;
+  return filepwrite(f, p, n, off);
+}
+
 uint64
 sys_close(void)
 {
@@ -123,6 +152,7 @@ sys_link(void)
 {
   char name[DIRSIZ], new[MAXPATH], old[MAXPATH];
   struct inode *dp, *ip;
+  struct sleeplock *nlk;
 
   if (argstr(0, old, MAXPATH) < 0 || argstr(1, new, MAXPATH) < 0)
     return -1;
@@ -148,13 +178,17 @@ sys_link(void)
 
   if ((dp = nameiparent(new, name)) == 0)
     goto bad;
+  nlk = dirnamelock(dp, name);
+  acquiresleep(nlk);
   ilock(dp);
   if (dp->dev != ip->dev || dirlink(dp, name, ip->inum) < 0)
   {
     iunlockput(dp);
+    releasesleep(nlk);
     goto bad;
   }
   iunlockput(dp);
+  releasesleep(nlk);
   iput(ip);
 
   end_op();
@@ -170,40 +204,16 @@ bad:
   return -1;
 }
 
-// Is the directory dp empty except for "." and ".." ?
+// Remove path. The caller is inside a transaction.
 static int
-isdirempty(struct inode *dp)
-{
-  int off;
-  struct dirent de;
-
-  for (off = 2 * sizeof(de); off < dp->size; off += sizeof(de))
-  {
-    if (readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("isdirempty: readi");
-    if (de.inum != 0)
-      return 0;
-  }
-  return 1;
-}
-
-uint64
-sys_unlink(void)
+dounlink(char *path)
 {
   struct inode *ip, *dp;
-  struct dirent de;
-  char name[DIRSIZ], path[MAXPATH];
+  char name[DIRSIZ];
   uint off;
 
-  if (argstr(0, path, MAXPATH) < 0)
-    return -1;
-
-  begin_op();
   if ((dp = nameiparent(path, name)) == 0)
-  {
-    end_op();
     return -1;
-  }
 
   ilock(dp);
 
@@ -217,15 +227,13 @@ sys_unlink(void)
 
   if (ip->nlink < 1)
     panic("unlink: nlink < 1");
-  if (ip->type == T_DIR && !isdirempty(ip))
+  if (ip->type == T_DIR && !dirempty(ip))
   {
     iunlockput(ip);
     goto bad;
   }
 
-  memset(&de, 0, sizeof(de));
-  if (writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-    panic("unlink: writei");
+  dirunlink(dp, name, off);
   if (ip->type == T_DIR)
   {
     dp->nlink--;
@@ -234,36 +242,60 @@ sys_unlink(void)
   iunlockput(dp);
 
   ip->nlink--;
+  if (ip->type == T_DIR)
+    dcache_purge(ip->dev, ip->inum);  // its inum may be reused by a file
   iupdate(ip);
   iunlockput(ip);
 
-  end_op();
-
   return 0;
 
 bad:
   iunlockput(dp);
-  end_op();
   return -1;
 }
 
+uint64
+sys_unlink(void)
+{
+  char path[MAXPATH];
+  int r;
+
+  if (argstr(0, path, MAXPATH) < 0)
+    return -1;
+
+  begin_op();
+  r = dounlink(path);
+  end_op();
+  return r;
+}
+
 static struct inode *
 create(char *path, short type, short major, short minor)
 {
   struct inode *ip, *dp;
+  struct sleeplock *nlk;
   char name[DIRSIZ];
 
   if ((dp = nameiparent(path, name)) == 0)
     return 0;
 
-  ilock(dp);
+  // The name's bucket lock keeps it free until it is linked, so
+  // dp need only be locked to search it and to link the name.
+  nlk = dirnamelock(dp, name);
+  acquiresleep(nlk);
+  ilockshared(dp);
 
   if ((ip = dirlookup(dp, name, 0)) != 0)
   {
-    iunlockput(dp);
+    iunlockshared(dp);
+    iput(dp);
+    releasesleep(nlk);
     ilock(ip);
     if (type == T_FILE && (ip->type == T_FILE || ip->type == T_DEVICE))
       return ip;
+    // defrag turns files into T_EXTENT, so either kind reopens one.
+    if ((type == T_FILE || type == T_EXTENT) && ip->type == T_EXTENT)
+      return ip;
     //symlink
     if (ip->type == T_SYMLINK) {
             return ip;
@@ -271,31 +303,74 @@ create(char *path, short type, short major, short minor)
     iunlockput(ip);
     return 0;
   }
+  iunlockshared(dp);
 
   if ((ip = ialloc(dp->dev, type)) == 0)
-    panic("create: ialloc");
+  {
+    releasesleep(nlk);
+    iput(dp);
+    return 0;
+  }
 
   ilock(ip);
   ip->major = major;
   ip->minor = minor;
   ip->nlink = 1;
   ip->showmode = 1;
+  if(type == T_FILE || type == T_EXTENT || type == T_SYMLINK)
+    ip->flags |= I_INLINE;  // small files and short links live in the inode
   iupdate(ip);
 
   // new
   if(type == T_DIR){  // Create . and .. entries.
-    dp->nlink++;  // for ".."
-    iupdate(dp);
     // No ip->nlink++ for ".": avoid cyclic ref count.
     //if(dirlink(ip, ".", ip->inum) < 0 || dirlink(ip, "..", dp->inum) < 0)
     //  panic("cannot create . or ..");
     build_dir_tree(ip, dp->inum);
   }
+
+  // Most names fit in a free slot of their leaf, which needs dp
+  // only shared. Making room, and the ".." link of a new
+  // directory, change dp and need it locked with ilock().
+  if(type != T_DIR){
+    ilockshared(dp);
+    if(dp->nlink != 0 && dirlinkshared(dp, name, ip->inum) == 0){
+      iunlockshared(dp);
+      iput(dp);
+      releasesleep(nlk);
+      return ip;
+    }
+    iunlockshared(dp);
+  }
+
+  ilock(dp);
+  if(dp->nlink == 0){
+    // dp was removed while it was unlocked; free ip again.
+    iunlockput(dp);
+    releasesleep(nlk);
+    ip->nlink = 0;
+    iupdate(ip);
+    iunlockput(ip);
+    return 0;
+  }
   //panic("debug to see create 'init'");
-  if(dirlink(dp, name, ip->inum) < 0)
-    panic("create: dirlink");
+  if(dirlink(dp, name, ip->inum) < 0){
+    // no room for the name: a leaf of equal hashes that cannot
+    // split, or a full index. Free ip again.
+    iunlockput(dp);
+    releasesleep(nlk);
+    ip->nlink = 0;
+    iupdate(ip);
+    iunlockput(ip);
+    return 0;
+  }
+  if(type == T_DIR){
+    dp->nlink++;  // for ".."
+    iupdate(dp);
+  }
 
   iunlockput(dp);
+  releasesleep(nlk);
 
   return ip;
 }
@@ -308,18 +383,23 @@ sys_open(void)
   char password[30];
   struct file *f;
   struct inode *ip;
-  int n;
+  int n, tx;
 
   // new
   if ((n = argstr(0, path, MAXPATH)) < 0 || argint(1, &omode) < 0 || argstr(2, password, 30) < 0)
     return -1;
 
-  begin_op();
+  // Only creating or truncating writes to the disk; a plain
+  // open needs no log space (inodes it lets go of are put
+  // with iputlazy()).
+  tx = omode & (O_CREATE | O_TRUNC);
+  if (tx)
+    begin_op();
 
   if (omode & O_CREATE)
   {
     // new
-    if(omode == O_EXTENT){
+    if(omode & O_EXTENT){
       ip = create(path, T_EXTENT, 0, 0); // in extent way
     }
     else{
@@ -327,7 +407,8 @@ sys_open(void)
     }
     if (ip == 0)
     {
-      end_op();
+      if (tx)
+        end_op();
       return -1;
     }
   }
@@ -335,28 +416,33 @@ sys_open(void)
   {
     if ((ip = namei(path)) == 0)
     {
-      end_op();
+      if (tx)
+        end_op();
       return -1;
     }
     ilock(ip);
     if (ip->type == T_DIR && omode != O_RDONLY)
     {
-      iunlockput(ip);
-      end_op();
+      iunlockputlazy(ip);
+      if (tx)
+        end_op();
       return -1;
     }
   }
   // symlink
   int cnt = 0;
     while (ip->type == T_SYMLINK && !(omode & O_NOFOLLOW)) {
-        if ((n = readi(ip, 0, (uint64)path, 0, MAXPATH)) != MAXPATH) {
-            iunlockput(ip);
-            end_op();
+        if ((n = readi(ip, 0, (uint64)path, 0, MAXPATH - 1)) <= 0) {
+            iunlockputlazy(ip);
+            if (tx)
+              end_op();
             return -1;
         }
-        iunlockput(ip);
+        path[n] = 0;
+        iunlockputlazy(ip);
         if ((ip = namei(path)) == 0 || ++cnt > 10) {
-            end_op();
+            if (tx)
+              end_op();
             return -1;
         }
         ilock(ip);
@@ -365,8 +451,9 @@ sys_open(void)
 
   if (ip->type == T_DEVICE && (ip->major < 0 || ip->major >= NDEV))
   {
-    iunlockput(ip);
-    end_op();
+    iunlockputlazy(ip);
+    if (tx)
+      end_op();
     return -1;
   }
 
@@ -374,8 +461,9 @@ sys_open(void)
   {
     if (f)
       fileclose(f);
-    iunlockput(ip);
-    end_op();
+    iunlockputlazy(ip);
+    if (tx)
+      end_op();
     return -1;
   }
 
@@ -383,6 +471,17 @@ sys_open(void)
   if (ip->supermode == 1 && strncmp(password, "iam@admin9876", 13) != 0)
   {
     printf("only admin can open this file!\n");
+    iunlockputlazy(ip);
+    if (tx)
+      end_op();
+    return -1;
+  }
+
+  // O_TRUNC implies a transaction (tx).
+  if ((omode & O_TRUNC) && (ip->type == T_FILE || ip->type == T_EXTENT) && itrunc(ip) < 0)
+  {
+    myproc()->ofile[fd] = 0;
+    fileclose(f);
     iunlockput(ip);
     end_op();
     return -1;
@@ -397,18 +496,15 @@ sys_open(void)
   {
     f->type = FD_INODE;
     f->off = omode & O_APPEND ? ip->size : 0;
+    f->dc.off = -1;  // no place in a directory index yet
   }
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
 
-  if ((omode & O_TRUNC) && ip->type == T_FILE)
-  {
-    itrunc(ip);
-  }
-
   iunlock(ip);
-  end_op();
+  if (tx)
+    end_op();
 
   return fd;
 }
@@ -458,22 +554,17 @@ sys_chdir(void)
   struct inode *ip;
   struct proc *p = myproc();
 
-  begin_op();
   if (argstr(0, path, MAXPATH) < 0 || (ip = namei(path)) == 0)
-  {
-    end_op();
     return -1;
-  }
-  ilock(ip);
+  ilockshared(ip);
   if (ip->type != T_DIR)
   {
-    iunlockput(ip);
-    end_op();
+    iunlockshared(ip);
+    iputlazy(ip);
     return -1;
   }
-  iunlock(ip);
-  iput(p->cwd);
-  end_op();
+  iunlockshared(ip);
+  iputlazy(p->cwd);
   p->cwd = ip;
   return 0;
 }
@@ -558,26 +649,36 @@ sys_pipe(void)
   return 0;
 }
 
+// Make path a symbolic link to target. The caller is inside
+// a transaction.
+static int
+dosymlink(char *target, char *path)
+{
+    // Store just the target's bytes: a short one fits in the
+    // inode (see writei), so no data block is needed.
+    int n = strlen(target);
+    struct inode *ip;
+    if ((ip = create(path, T_SYMLINK, 0, 0)) == 0)
+        return -1;
+    if (writei(ip, 0, (uint64)target, 0, n) != n) {
+        iunlockput(ip);
+        return -1;
+    }
+    iunlockput(ip);
+    return 0;
+}
+
 uint64 sys_symlink(void) {
     char target[MAXPATH], path[MAXPATH];
+    int r;
     if (argstr(0, target, MAXPATH) < 0 || argstr(1, path, MAXPATH) < 0) {
         return -1;
     }
 
     begin_op();
-    struct inode *ip;
-    if ((ip = create(path, T_SYMLINK, 0, 0)) == 0) {
-        end_op();
-        return -1;
-    }
-    if (writei(ip, 0, (uint64)target, 0, MAXPATH) != MAXPATH) {
-        end_op();
-        return -1;
-    }
-    iupdate(ip);
-    iunlockput(ip);
+    r = dosymlink(target, path);
     end_op();
-    return 0;
+    return r;
 }
 uint64
 sys_fsinfo(void)
@@ -626,7 +727,6 @@ uint64 sys_delete(void)
   {
     // unlink
     struct inode *dp;
-    struct dirent de;
     char name[DIRSIZ];
     uint off;
     if ((dp = nameiparent(path, name)) == 0)
@@ -654,18 +754,14 @@ uint64 sys_delete(void)
     {
       panic("unlink: nlink < 1");
     }
-    if (ip->type == T_DIR && !isdirempty(ip))
+    if (ip->type == T_DIR && !dirempty(ip))
     {
       iunlockput(dp);
       iunlock(ip);
       end_op();
       return -1;
     }
-    memset(&de, 0, sizeof(de));
-    if (writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-    {
-      panic("unlink: writei");
-    }
+    dirunlink(dp, name, off);
     if (ip->type == T_DIR)
     {
       dp->nlink--;
@@ -673,6 +769,8 @@ uint64 sys_delete(void)
     }
     iunlockput(dp);
     ip->nlink--;
+    if (ip->type == T_DIR)
+      dcache_purge(ip->dev, ip->inum);  // its inum may be reused by a file
     printf("deleted forever\n");
     
   }
@@ -755,14 +853,18 @@ sys_showstat(void)
   printf("links num: %d\n", st.nlink);
   printf("file size(Bytes): %d\n", st.size);
 
-  // files that use extent:pointer and length
-  if(st.type == T_EXTENT) {
-      int ad = 0;
-      while(st.addrs[ad] && ad < NDIRECT+1){
-        printf("\nthis file is using extent\n");
-        printf("pointer: 0x%x\n", ((st.addrs[ad] & ~0xff) >> 8));
-        printf("length: 0x%d\n", (st.addrs[ad] & 0xff));
-        ++ad;
+  // files that use extent: the root node of the extent tree
+  struct extent_header *eh = (struct extent_header*)st.addrs;
+  if(st.type == T_EXTENT && eh->magic == EXT_MAGIC) {
+      printf("\nthis file is using extent, tree depth %d\n", eh->depth);
+      for(int ad = 0; ad < eh->entries; ad++){
+        if(eh->depth == 0){
+          struct extent *e = (struct extent*)(eh + 1) + ad;
+          printf("logical: %d pointer: 0x%x length: %d\n", e->lblk, e->pblk, e->len);
+        } else {
+          struct extent_idx *ei = (struct extent_idx*)(eh + 1) + ad;
+          printf("logical: %d index block: 0x%x\n", ei->lblk, ei->child);
+        }
       }
   }
   return 0;
@@ -772,11 +874,14 @@ uint64
 sys_lseek(void)
 {
   struct file *f;
-  int off, newoff;
+  uint64 arg;
+  int64 off, newoff;
   int whence;
 
-  if(argfd(0, 0, &f) < 0 || argint(1, &off) < 0 || argint(2, &whence) < 0)
+  // off is a full 64-bit register, so files can pass 4GB
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &arg) < 0 || argint(2, &whence) < 0)
     return -1;
+  off = (int64)arg;
 
   if(f->type != FD_INODE)
     return -1;
@@ -800,12 +905,166 @@ sys_lseek(void)
     break;
   }
 
+  // seeking past the end is fine; a write there leaves a hole
   if(newoff < 0)
     return -1;
 
-  if(newoff > f->ip->size)
-    newoff = f->ip->size;
-
 return f->off = newoff;   
 
 }
+
+// Move an open file's data into contiguous extents.
+uint64
+sys_defrag(void)
+{
+  struct file *f;
+  struct defragstat ds;
+  uint64 addr;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &addr) < 0)
+    return -1;
+  if(f->type != FD_INODE || !f->writable)
+    return -1;
+  if(idefrag(f->ip, &ds) < 0)
+    return -1;
+  if(copyout(myproc()->pagetable, addr, (char*)&ds, sizeof(ds)) < 0)
+    return -1;
+  return 0;
+}
+
+// Return up to n entries of an open directory, from its
+// current offset on, with each entry's attributes, so that a
+// listing needs no stat() per name. Empty leaves are skipped. Returns the number of
+// entries, 0 at the end of the directory.
+#define NGETDENTS 16
+
+uint64
+sys_getdents(void)
+{
+  struct file *f;
+  struct inode *dp, *ip, *ips[NGETDENTS];
+  struct direntplus ents[NGETDENTS];
+  struct dirent de;
+  uint64 addr;
+  int n, got, i, k, private;
+
+  if(argfd(0, 0, &f) < 0 || argaddr(1, &addr) < 0 || argint(2, &n) < 0)
+    return -1;
+  if(f->type != FD_INODE || !f->readable || f->ip->type != T_DIR)
+    return -1;
+  dp = f->ip;
+
+  for(got = 0; got < n; got += k){
+    // Take a reference to each named inode with the directory
+    // locked, so none can be freed before it is read below.
+    // dirnext() changes only f's offset and cursor, so as in
+    // fileread() dp is locked shared unless f itself is shared.
+    if((private = f->ref == 1))
+      ilockshared(dp);
+    else
+      ilock(dp);
+    for(k = 0; k < NGETDENTS && got + k < n && dirnext(dp, &f->off, &f->dc, &de); k++){
+      ips[k] = iget(dp->dev, de.inum);
+      memmove(ents[k].name, de.name, DIRSIZ);
+      ents[k].name[DIRSIZ] = 0;
+    }
+    if(private)
+      iunlockshared(dp);
+    else
+      iunlock(dp);
+    if(k == 0)
+      break;
+
+    // Read their inode blocks in parallel, then lock the
+    // inodes (shared) one at a time, as namex() does.
+    for(i = 0; i < k; i++)
+      ireadahead(ips[i]);
+    for(i = 0; i < k; i++){
+      ip = ips[i];
+      ilockshared(ip);
+      ents[i].ino = ip->inum;
+      ents[i].type = ip->type;
+      ents[i].nlink = ip->nlink;
+      ents[i].size = ip->size;
+      ents[i].rwmode = ip->rwmode;
+      ents[i].supermode = ip->supermode;
+      ents[i].showmode = ip->showmode;
+      iunlockshared(ip);
+      iputlazy(ip);
+    }
+    if(copyout(myproc()->pagetable, addr + got*sizeof(ents[0]), (char*)ents, k*sizeof(ents[0])) < 0)
+      return -1;
+  }
+  return got;
+}
+
+// new
+// Run n metadata operations from the user array ops as few
+// transactions: each op joins the current one while the log
+// has room for it, so the batch commits once per log's worth
+// of ops rather than once per op. Sets each op's status and
+// returns how many succeeded.
+uint64
+sys_fsbatch(void)
+{
+  struct proc *p = myproc();
+  struct fsop op;
+  struct inode *ip;
+  char path[MAXPATH], target[MAXPATH];
+  uint64 addr;
+  int n, i, r, ok;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0 || n < 0)
+    return -1;
+
+  ok = 0;
+  begin_op();
+  for(i = 0; i < n; i++, addr += sizeof(op)){
+    if(i > 0 && !log_hasroom()){
+      end_op();
+      begin_op();
+    }
+    if(copyin(p->pagetable, (char*)&op, addr, sizeof(op)) < 0)
+      break;
+    r = -1;
+    if(fetchstr((uint64)op.path, path, MAXPATH) < 0)
+      goto done;
+    switch(op.op){
+    case FSOP_CREATE:
+    case FSOP_MKDIR:
+      if((ip = create(path, op.op == FSOP_MKDIR ? T_DIR : T_FILE, 0, 0)) != 0){
+        iunlockput(ip);
+        r = 0;
+      }
+      break;
+    case FSOP_UNLINK:
+      r = dounlink(path);
+      break;
+    case FSOP_SYMLINK:
+      if(fetchstr((uint64)op.target, target, MAXPATH) >= 0)
+        r = dosymlink(target, path);
+      break;
+    case FSOP_SETRW:
+    case FSOP_SETSHOW:
+      if((ip = namei(path)) == 0)
+        break;
+      ilock(ip);
+      if(op.op == FSOP_SETRW)
+        ip->rwmode = op.mode;
+      else
+        ip->showmode = op.mode;
+      iupdate(ip);
+      iunlockput(ip);
+      r = 0;
+      break;
+    }
+  done:
+    if(r == 0)
+      ok++;
+    op.status = r;
+    if(copyout(p->pagetable, addr, (char*)&op, sizeof(op)) < 0)
+      break;
+  }
+  end_op();
+  return ok;
+}
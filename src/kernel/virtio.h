@@ -44,8 +44,9 @@
 #define VIRTIO_RING_F_EVENT_IDX     29
 
 // this many virtio descriptors.
-// must be a power of two.
-#define NUM 8
+// must be a power of two. each request takes three, so
+// this allows ten requests in flight (see breadahead()).
+#define NUM 32
 
 // a single descriptor, from the spec.
 struct virtq_desc {
@@ -63,6 +63,7 @@ static struct disk {
   struct {
     struct buf *b;
     char status;
+    char async;  // read-ahead: nobody waits, intr finishes it
   } info[NUM];
 
   // disk command headers.
@@ -200,26 +201,13 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// Queue a request for b on descriptors idx[0..2] and tell
+// the device. Caller holds disk.vdisk_lock.
+static void
+submit(struct buf *b, int write, int *idx)
 {
   uint64 sector = b->blockno * (BSIZE / 512);
 
-  acquire(&disk.vdisk_lock);
-
-  // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
-
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
-
   // format the three descriptors.
   // qemu's virtio-blk.c reads them.
 
@@ -267,6 +255,28 @@ virtio_disk_rw(struct buf *b, int write)
   __sync_synchronize();
 
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+}
+
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  acquire(&disk.vdisk_lock);
+
+  // the spec's Section 5.2 says that legacy block operations use
+  // three descriptors: one for type/reserved/sector, one for the
+  // data, one for a 1-byte status result.
+
+  // allocate the three descriptors.
+  int idx[3];
+  while(1){
+    if(alloc3_desc(idx) == 0) {
+      break;
+    }
+    sleep(&disk.free[0], &disk.vdisk_lock);
+  }
+
+  disk.info[idx[0]].async = 0;
+  submit(b, write, idx);
 
   // Wait for virtio_disk_intr() to say request has finished.
   while(b->disk == 1) {
@@ -279,6 +289,27 @@ virtio_disk_rw(struct buf *b, int write)
   release(&disk.vdisk_lock);
 }
 
+// Start reading b and return without waiting; when the read
+// is done, virtio_disk_intr() passes b to breadahead_done().
+// Returns -1 if all descriptors are busy, rather than
+// sleeping: read-ahead is only worth it while the disk has
+// room.
+int
+virtio_disk_read_async(struct buf *b)
+{
+  int idx[3];
+
+  acquire(&disk.vdisk_lock);
+  if(alloc3_desc(idx) < 0){
+    release(&disk.vdisk_lock);
+    return -1;
+  }
+  disk.info[idx[0]].async = 1;
+  submit(b, 0, idx);
+  release(&disk.vdisk_lock);
+  return 0;
+}
+
 void
 virtio_disk_intr()
 {
@@ -306,7 +337,12 @@ virtio_disk_intr()
 
     struct buf *b = disk.info[id].b;
     b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    if(disk.info[id].async){
+      disk.info[id].b = 0;
+      free_chain(id);
+      breadahead_done(b);
+    } else
+      wakeup(b);
 
     disk.used_idx += 1;
   }
@@ -4,6 +4,7 @@
 #include <string.h>
 #include <fcntl.h>
 #include <assert.h>
+#include <time.h>
 
 #define stat xv6_stat  // avoid clash with host struct stat
 #include "kernel/types.h"
@@ -44,6 +45,7 @@ void iappend(uint inum, void *p, int n);
 void die(const char *);
 // new
 void iappend_init_dir(uint inum, struct dirent *de);
+void iappend_finish_dir(uint inum);
 void setibmap(int);
 void updatesb(void);
 void test_xpr(void);
@@ -78,7 +80,7 @@ main(int argc, char *argv[])
   uint rootino, inum;
   struct dirent de;
   char buf[BSIZE];
-  //struct dinode din;
+  struct dinode din;
 
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
@@ -108,6 +110,8 @@ main(int argc, char *argv[])
   sb.ibmapstart = xint(2+nlog);
   sb.inodestart = xint(2+nlog+nibitmap);
   sb.bmapstart = xint(2+nlog+nibitmap+ninodeblocks);
+  // a different name hash on every file system
+  sb.hashseed = xint(time(0) ^ (getpid() << 16));
 
   printf("nmeta %d (boot, super, log blocks %u, inode bitmap blocks %u, inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
          nmeta, nlog, nibitmap,   ninodeblocks, nbitmap, nblocks, FSSIZE);
@@ -162,18 +166,25 @@ main(int argc, char *argv[])
     //iappend(rootino, &de, sizeof(de));
     iappend_init_dir(rootino,&de);
 
-    while((cc = read(fd, buf, sizeof(buf))) > 0)
-      iappend(inum, buf, cc);
+    // Files that fit are stored in the inode itself.
+    cc = lseek(fd, 0, SEEK_END);
+    lseek(fd, 0, SEEK_SET);
+    if(cc <= IDATASIZE){
+      rinode(inum, &din);
+      if(read(fd, din.data, cc) != cc)
+        die(argv[i]);
+      din.size = xint(cc);
+      din.flags = xint(I_INLINE);
+      winode(inum, &din);
+    } else {
+      while((cc = read(fd, buf, sizeof(buf))) > 0)
+        iappend(inum, buf, cc);
+    }
 
     close(fd);
   }
 
-  // // fix size of root inode dir
-  // rinode(rootino, &din);
-  // off = xint(din.size);
-  // off = ((off/BSIZE) + 1) * BSIZE;
-  // din.size = xint(off);
-  // winode(rootino, &din);
+  iappend_finish_dir(rootino);
 
   balloc(freeblock);
   setibmap(freeinode);
@@ -315,198 +326,93 @@ die(const char *s)
   perror(s);
   exit(1);
 }
-uint cal_block_index_for_dinode(struct dinode* dp,unsigned int bn)
-{
 
- if(bn<1)
-  {
-    die("bn=0 should be given to . and ..");
-  }
-  if(bn<OVERFLOW_BLOCK)
-  return bn;
-  die("cal_block_index: out of range");
-  return 0;
+// Name hash of the new file system, as the kernel computes it.
+uint
+namehash_mkfs(char *name)
+{
+  return dx_hash(xint(sb.hashseed), name);
 }
 
+// Entries of the root directory, collected by iappend_init_dir()
+// and written out as a hash index by iappend_finish_dir().
+#define MAXROOTENTS (DX_ROOT_LIMIT * DX_LEAF_ENTS / 2)
+struct dirent rootents[MAXROOTENTS];
+int nrootents;
 
-// 在父目录dp下申请block，使得申请到的block是连续的
-// 会改变dp->size的大小
-// @return:addr of block related to 'off'
-// 模仿bmap的写法
-uint dir_block_allocation_continuation(struct dinode *dp, uint block)
+// @MaQi
+// 初始化的时候将第一批文件的目录项*de 加入到inum对应的目录中
+void iappend_init_dir(uint inum, struct dirent *de)
 {
-  uint bn = block + 1, b = 0, baddr;
-  for (; b < min(bn, NDIRECT); ++b)
-  {
-    if (dp->addrs[b] == 0)
-      dp->addrs[b] = xint(freeblock++);
-  }
-  if (bn <= NDIRECT)
-    baddr = xint(dp->addrs[bn - 1]);
-  else
-  {
-    uint ibn = bn - NDIRECT;
-    // Load indirect block, allocating if necessary.
-    uint addr, indirect[NINDIRECT];
-    if ((addr = dp->addrs[NDIRECT]) == 0)
-      dp->addrs[NDIRECT] = addr = xint(freeblock++);
-    rsect(xint(addr), (char *)indirect);
-    for (b = 0; b < ibn; ++b)
-    {
-      if (indirect[b] == 0)
-      {
-        indirect[b] = xint(freeblock++);
-        wsect(xint(addr), (char *)indirect);
-      }
-    }
-    baddr = xint(indirect[ibn - 1]);
-  }
-  dp->size = bn * BSIZE > dp->size ? bn * BSIZE : dp->size;
-  return baddr;
+  assert(inum == ROOTINO);
+  assert(nrootents < MAXROOTENTS);
+  rootents[nrootents++] = *de;
 }
 
-// 溢出区块连续化
-uint overflow_block_allocation_continuation(struct dinode *dp, uint off)
+static int
+dirent_cmp(const void *a, const void *b)
 {
-  uint bn = off / BSIZE + 1, b = 0, baddr;
-  for (; b < min(bn, NDIRECT); ++b)
-  {
-    if (dp->addrs[b] == 0)
-      dp->addrs[b] = xint(freeblock++);
-  }
-  if (bn <= NDIRECT)
-    baddr = xint(dp->addrs[bn - 1]);
-  else
-  {
-    uint ibn = bn - NDIRECT;
-    // Load indirect block, allocating if necessary.
-    uint addr, indirect[NINDIRECT];
-    if ((addr = dp->addrs[NDIRECT]) == 0)
-      dp->addrs[NDIRECT] = addr = xint(freeblock++);
-    rsect(xint(addr), (char *)indirect);
-    for (b = 0; b < ibn; ++b)
-    {
-      if (indirect[b] == 0)
-      {
-        indirect[b] = xint(freeblock++);
-        wsect(xint(addr), (char *)indirect);
-      }
-    }
-    baddr = xint(indirect[ibn - 1]);
-  }
-  dp->size = bn * BSIZE > dp->size ? bn * BSIZE : dp->size;
-  return baddr;
+  uint ha = namehash_mkfs(((struct dirent*)a)->name);
+  uint hb = namehash_mkfs(((struct dirent*)b)->name);
+
+  return ha < hb ? -1 : ha > hb;
 }
 
-unsigned int BKDRHash_mkfs(char * str)
+// Write the collected entries the way the kernel lays out a
+// directory. If they fit, they simply follow "." and ".." in
+// block 0; otherwise block 0 gets the root of a hash index and
+// the names go in leaves sorted by hash, filled to three
+// quarters so the first creates do not split them. Equal
+// hashes always share a leaf.
+void iappend_finish_dir(uint inum)
 {
-    unsigned int seed=131;
-    unsigned int hash=0;
-    while (*str)
-    {
-        hash=hash*seed+(*str++);
+  struct dinode din;
+  char buf[BSIZE];
+  struct dirent leaf[DX_LEAF_ENTS];
+  struct dx_head *hd;
+  struct dx_entry *ents;
+  uint h;
+  int i, n, nleaves;
 
+  rinode(inum, &din);
+  rsect(xint(din.addrs[0]), buf);
+  din.size = xint(BSIZE);
+  if(nrootents <= DX_LEAF_ENTS - 2){
+    memmove(buf + 2*sizeof(struct dirent), rootents, nrootents * sizeof(struct dirent));
+    wsect(xint(din.addrs[0]), buf);
+    winode(inum, &din);
+    return;
+  }
+  din.flags = xint(I_INDEX);
+  winode(inum, &din);
+
+  qsort(rootents, nrootents, sizeof(struct dirent), dirent_cmp);
+  hd = (struct dx_head*)(buf + 2*sizeof(struct dirent));
+  ents = (struct dx_entry*)(hd + 1);
+
+  i = nleaves = 0;
+  do {
+    assert(nleaves < DX_ROOT_LIMIT);
+    bzero(leaf, sizeof(leaf));
+    h = nleaves == 0 ? 0 : namehash_mkfs(rootents[i].name);
+    for(n = 0; i < nrootents && n < DX_LEAF_ENTS*3/4; n++)
+      leaf[n] = rootents[i++];
+    while(i < nrootents && namehash_mkfs(rootents[i].name) == namehash_mkfs(rootents[i-1].name)){
+      assert(n < DX_LEAF_ENTS);
+      leaf[n++] = rootents[i++];
     }
-    
-    return (hash % HASHRANGE)+16;// HASHRANGE是哈希值范围
-}
-// @MaQi
-// 初始化的时候将第一批文件的目录项*de 加入到inum对应的目录中
-void iappend_init_dir(uint inum, struct dirent *de)
-{
-  uint tree_node_off = 0, tree_next_node_off,tree_node_block;
-  struct dinode dir_inode;
-  //unsigned int inner_node_off;
-  unsigned int hash_value;
-  
-  char buf[BSIZE];//缓冲区
-
-  // 读入inum对应的inode到dir_inode当中
-  rinode(inum, &dir_inode);
-
-  // while (tree_node_off < MAXFSIZE)
-  // {
-    hash_value=BKDRHash_mkfs(de->name);
-    // if (tree_node_off<(hash_value+1)*4*sizeof(struct dirent))
-    // {
-      /*
-      lower_bound_block=hash_value/16;
-      tree_node_block=cal_block_index_for_dinode(&dir_inode,lower_bound_block);
-      inner_node_off=hash_value%(NUM_DIRENT_PER_BLOCK/4)*4*sizeof(struct dirent);
-      tree_node_off=tree_node_block*BSIZE+inner_node_off;
-      tree_next_node_off=tree_node_off+4*sizeof(struct dirent);
-      */
-
-      tree_node_off=hash_value*16*sizeof(struct dirent);
-      tree_next_node_off=(hash_value+1)*16*sizeof(struct dirent);
-      tree_node_block=tree_node_off/BSIZE;
-
-      //tree_next_node_off=min(cal_block_index_for_dinode(&dir_inode,lower_bound_block+1)*BSIZE,MAXFSIZE);
-      // 这一区域需要block连续化
-      
-      tree_node_block=dir_block_allocation_continuation(&dir_inode,tree_node_block);
-      
-      //printf("iappend_init_dir: %s direct hash %d\n", de->name, hash_value);
-    //}
-    
-    for (; tree_node_off < tree_next_node_off; tree_node_off += sizeof(struct dirent))
-    {
-      uint addr_of_block;
-      // 理论上来说，这个里面的block应该是连续的
-      // 所以这里还可以改进，申请只管这个块
-      //如果是溢出区的访问，需要执行逐步块分配
-      if(tree_node_off>=113*BSIZE)
-      {
-        addr_of_block=overflow_block_allocation_continuation(&dir_inode, tree_node_off);
-      }
-      else{
-        addr_of_block = tree_node_block;
-      }
-      rsect(addr_of_block, buf);
-      struct dirent *p_dirent = (struct dirent *)(buf + (tree_node_off % BSIZE));
-      if (p_dirent->inum == 0)//如果这个地方的dirent是空的
-      {
-        bcopy(de, buf + (tree_node_off % BSIZE), sizeof(struct dirent));
-        wsect(addr_of_block, buf);
-        winode(inum, &dir_inode);//写入这个目录项的内容
-        // 断言：偏置一定是16的倍数
-        assert(tree_node_off % 16 == 0);
-        //printf("iappend_init_dir: wrote %s at offset %d\n", de->name, tree_node_off);
-        return;
-      }
-    }
-    
-      // overflow
-      tree_node_off=113*BSIZE;
-      tree_next_node_off=115*BSIZE;//MAXFSIZE;
-      printf("iappend_init_dir: %s overflow\n", de->name);
-    for (; tree_node_off < tree_next_node_off; tree_node_off += sizeof(struct dirent))
-    {
-      uint addr_of_block;
-      // 理论上来说，这个里面的block应该是连续的
-      // 所以这里还可以改进，申请只管这个块
-      //如果是溢出区的访问，需要执行逐步块分配
-      if(tree_node_off>=113*BSIZE)
-      {
-        addr_of_block=overflow_block_allocation_continuation(&dir_inode, tree_node_off);
-      }
-      else{
-        addr_of_block = tree_node_block;
-      }
-      rsect(addr_of_block, buf);
-      struct dirent *p_dirent = (struct dirent *)(buf + (tree_node_off % BSIZE));
-      if (p_dirent->inum == 0)//如果这个地方的dirent是空的
-      {
-        bcopy(de, buf + (tree_node_off % BSIZE), sizeof(struct dirent));
-        wsect(addr_of_block, buf);
-        winode(inum, &dir_inode);//写入这个目录项的内容
-        // 断言：偏置一定是16的倍数
-        assert(tree_node_off % 16 == 0);
-        printf("iappend_init_dir: wrote %s at offset %d\n", de->name, tree_node_off);
-        return;
-      }
-    }
-  //}
+    ents[nleaves].hash = xint(h);
+    ents[nleaves].block = xint(nleaves + 1);
+    ents[nleaves].count = xshort(n);
+    nleaves++;
+    iappend(inum, leaf, BSIZE);
+  } while(i < nrootents);
+
+  hd->magic = DX_MAGIC;
+  hd->count = xshort(nleaves);
+  hd->limit = xshort(DX_ROOT_LIMIT);
+  hd->names = xint(nrootents);
+  wsect(xint(din.addrs[0]), buf);
 }
 
 void
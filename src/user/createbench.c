@@ -0,0 +1,93 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fcntl.h"
+
+// createbench [nproc [nfiles]]
+// Fork nproc processes that each create (and then remove)
+// nfiles files in one shared directory, and report how many
+// ticks that took. Run it with 1, 2, 4... processes to see how
+// creates in a single directory scale.
+
+#define DIR "cbdir"
+
+void
+worker(int id, int nfiles, int unlinking)
+{
+  char path[32];
+  int i, fd;
+
+  strcpy(path, DIR "/c00_0000");
+  path[7] = 'a' + id / 26;
+  path[8] = 'a' + id % 26;
+  for(i = 0; i < nfiles; i++){
+    path[10] = '0' + i / 1000 % 10;
+    path[11] = '0' + i / 100 % 10;
+    path[12] = '0' + i / 10 % 10;
+    path[13] = '0' + i % 10;
+    if(unlinking){
+      if(unlink(path) < 0){
+        fprintf(2, "createbench: unlink %s failed\n", path);
+        exit(1);
+      }
+    } else {
+      if((fd = open(path, O_CREATE | O_RDWR, "iam@admin9876")) < 0){
+        fprintf(2, "createbench: create %s failed\n", path);
+        exit(1);
+      }
+      close(fd);
+    }
+  }
+  exit(0);
+}
+
+// Run nproc workers to completion; returns elapsed ticks.
+int
+run(int nproc, int nfiles, int unlinking)
+{
+  int i, t0, status, ok;
+
+  t0 = uptime();
+  for(i = 0; i < nproc; i++){
+    if(fork() == 0)
+      worker(i, nfiles, unlinking);
+  }
+  ok = 1;
+  for(i = 0; i < nproc; i++){
+    wait(&status);
+    if(status != 0)
+      ok = 0;
+  }
+  if(!ok){
+    fprintf(2, "createbench: a worker failed\n");
+    exit(1);
+  }
+  return uptime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nproc = 4, nfiles = 200, t;
+
+  if(argc > 1)
+    nproc = atoi(argv[1]);
+  if(argc > 2)
+    nfiles = atoi(argv[2]);
+  if(nproc < 1 || nproc > 26*26 || nfiles < 1 || nfiles > 10000){
+    fprintf(2, "usage: createbench [nproc [nfiles]]\n");
+    exit(1);
+  }
+  if(mkdir(DIR) < 0){
+    fprintf(2, "createbench: cannot mkdir %s\n", DIR);
+    exit(1);
+  }
+
+  t = run(nproc, nfiles, 0);
+  printf("%d procs x %d creates: %d ticks\n", nproc, nfiles, t);
+  t = run(nproc, nfiles, 1);
+  printf("%d procs x %d unlinks: %d ticks\n", nproc, nfiles, t);
+
+  unlink(DIR);
+  exit(0);
+}
@@ -0,0 +1,33 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fcntl.h"
+
+// defrag file...
+// Move each file's data into contiguous extents (converting
+// block-mapped files to T_EXTENT) and report the extent counts.
+int
+main(int argc, char *argv[])
+{
+  struct defragstat ds;
+  int i, fd, ret = 0;
+
+  if(argc < 2){
+    fprintf(2, "usage: defrag file...\n");
+    exit(1);
+  }
+  for(i = 1; i < argc; i++){
+    if((fd = open(argv[i], O_RDWR, "iam@admin9876")) < 0){
+      fprintf(2, "defrag: cannot open %s\n", argv[i]);
+      ret = 1;
+      continue;
+    }
+    if(defrag(fd, &ds) < 0){
+      fprintf(2, "defrag: %s: failed\n", argv[i]);
+      ret = 1;
+    } else
+      printf("%s: %d extents -> %d extents\n", argv[i], ds.before, ds.after);
+    close(fd);
+  }
+  exit(ret);
+}
@@ -0,0 +1,149 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+
+// dirstat dir...
+// Show how the names of a directory spread over the leaves of
+// its hash index: leaf fill, full (hot) leaves, and names that
+// share a hash with another name.
+
+#define NBINS 8
+
+struct superblock fs;
+int fd;
+int nindex, nleaves, nnames, nfull, nshared, minfill, maxfill;
+int bins[NBINS];
+
+int
+readblock(uint blk, char *buf)
+{
+  if(lseek(fd, (int64)blk * BSIZE, SEEK_SET) < 0 || read(fd, buf, BSIZE) != BSIZE)
+    return -1;
+  return 0;
+}
+
+void
+leaf(uint blk)
+{
+  static char buf[BSIZE];
+  struct dirent *de = (struct dirent*)buf;
+  uint h[DX_LEAF_ENTS];
+  int i, j, n;
+
+  if(readblock(blk, buf) < 0){
+    fprintf(2, "dirstat: cannot read leaf %d\n", blk);
+    return;
+  }
+  n = 0;
+  for(i = 0; i < DX_LEAF_ENTS; i++)
+    if(de[i].inum != 0)
+      h[n++] = dx_hash(fs.hashseed, de[i].name);
+  for(i = 0; i < n; i++)
+    for(j = 0; j < n; j++)
+      if(j != i && h[j] == h[i]){
+        nshared++;
+        break;
+      }
+  nleaves++;
+  nnames += n;
+  bins[n * NBINS / (DX_LEAF_ENTS + 1)]++;
+  if(n < minfill)
+    minfill = n;
+  if(n > maxfill)
+    maxfill = n;
+  if(n == DX_LEAF_ENTS){
+    nfull++;
+    printf("  hot leaf: block %d, hash 0x%x\n", blk, h[0]);
+  }
+}
+
+// Visit the entries of an index node, levels above the leaves.
+// Each level reads its children into its own buffer.
+void
+node(struct dx_head *hd, int levels)
+{
+  static char bufs[DX_MAXLEVELS][BSIZE];
+  struct dx_entry *ents = (struct dx_entry*)(hd + 1);
+  char *buf;
+  int i;
+
+  for(i = 0; i < hd->count; i++){
+    if(levels == 0){
+      leaf(ents[i].block);
+      continue;
+    }
+    buf = bufs[levels - 1];
+    if(readblock(ents[i].block, buf) < 0 || ((struct dx_head*)buf)->magic != DX_MAGIC){
+      fprintf(2, "dirstat: bad index block %d\n", ents[i].block);
+      continue;
+    }
+    nindex++;
+    node((struct dx_head*)buf, levels - 1);
+  }
+}
+
+void
+dirstat(char *path)
+{
+  static char buf[BSIZE];
+  struct dirent *de = (struct dirent*)buf;
+  struct dx_head *hd;
+  struct stat st;
+  int i, n;
+
+  if((fd = open(path, 0, "iam@admin9876")) < 0){
+    fprintf(2, "dirstat: cannot open %s\n", path);
+    return;
+  }
+  if(fstat(fd, &st) < 0 || st.type != T_DIR || readblock(0, buf) < 0){
+    fprintf(2, "dirstat: %s is not a directory\n", path);
+    close(fd);
+    return;
+  }
+
+  hd = (struct dx_head*)(buf + 2*sizeof(struct dirent));
+  if(hd->zero != 0 || hd->magic != DX_MAGIC){
+    for(i = n = 0; i < DX_LEAF_ENTS; i++)
+      if(de[i].inum != 0)
+        n++;
+    printf("%s: linear, %d of %d slots used\n", path, n, DX_LEAF_ENTS);
+    close(fd);
+    return;
+  }
+
+  printf("%s: hash index, %d levels, %l blocks\n", path, hd->levels + 1, st.size / BSIZE);
+  nindex = nleaves = nnames = nfull = nshared = maxfill = 0;
+  minfill = DX_LEAF_ENTS;
+  memset(bins, 0, sizeof(bins));
+  node(hd, hd->levels);
+  close(fd);
+
+  printf("  index blocks %d, leaves %d, names %d\n", nindex + 1, nleaves, nnames);
+  if(nleaves > 0)
+    printf("  leaf fill: min %d avg %d max %d of %d\n",
+           minfill, nnames / nleaves, maxfill, DX_LEAF_ENTS);
+  for(i = 0; i < NBINS; i++)
+    printf("  %d-%d names: %d leaves\n", (i * (DX_LEAF_ENTS + 1) + NBINS - 1) / NBINS,
+           ((i + 1) * (DX_LEAF_ENTS + 1) + NBINS - 1) / NBINS - 1, bins[i]);
+  printf("  full leaves %d, names sharing a hash %d\n", nfull, nshared);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i;
+
+  if(fsinfo(&fs) < 0){
+    fprintf(2, "dirstat: cannot read superblock\n");
+    exit(1);
+  }
+  if(argc < 2){
+    dirstat(".");
+    exit(0);
+  }
+  for(i = 1; i < argc; i++)
+    dirstat(argv[i]);
+  exit(0);
+}
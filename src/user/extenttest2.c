@@ -37,8 +37,16 @@ int extentfile(int filenum){
     end_tick=uptime();
     int read_time_cost=end_tick-start_tick;
     printf("read %d blocks to a file use%d ticks.\n",filenum,read_time_cost);
-    
-	
+
+    // O_CREATE|O_EXTENT must reopen the extent file it made.
+    struct stat st;
+    fd = open(fname, O_CREATE | O_RDWR | O_EXTENT,"iam@admin9876");
+    if(fd < 0 || fstat(fd, &st) < 0 || st.type != T_EXTENT || st.size != (uint64)filenum * sizeof(data)){
+        printf("reopen extent file with O_CREATE failed.\n");
+        exit(1);
+    }
+    close(fd);
+
     if(unlink(fname)<0){
         printf("remove file failed.\n");
     }
@@ -0,0 +1,88 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fcntl.h"
+
+// fsbatch: create files, change their modes and unlink some of
+// them in one batch, then check the results by reopening.
+
+#define N 40
+
+char names[N][16];
+struct fsop ops[3*N];
+
+int
+main(int argc, char *argv[])
+{
+  struct stat st;
+  int i, n, fd, ok = 1;
+
+  mkdir("fsbt");
+  for(i = 0; i < N; i++){
+    strcpy(names[i], "fsbt/f00");
+    names[i][6] = '0' + i / 10;
+    names[i][7] = '0' + i % 10;
+  }
+  n = 0;
+  for(i = 0; i < N; i++){
+    ops[n].op = FSOP_CREATE;
+    ops[n++].path = names[i];
+  }
+  for(i = 0; i < N; i++){
+    if(i % 3 == 0){
+      ops[n].op = FSOP_UNLINK;
+    } else if(i % 3 == 1){
+      ops[n].op = FSOP_SETRW;
+      ops[n].mode = 2;
+    } else {
+      ops[n].op = FSOP_SETSHOW;
+      ops[n].mode = 0;
+    }
+    ops[n++].path = names[i];
+  }
+  if(fsbatch(ops, n) != n){
+    printf("fsbatchtest: batch failed\n");
+    exit(1);
+  }
+
+  for(i = 0; i < N; i++){
+    fd = open(names[i], O_RDONLY, "iam@admin9876");
+    if(i % 3 == 0){
+      if(fd >= 0){
+        printf("fsbatchtest: %s not unlinked\n", names[i]);
+        ok = 0;
+        close(fd);
+      }
+      continue;
+    }
+    if(fd < 0 || fstat(fd, &st) < 0){
+      printf("fsbatchtest: %s not created\n", names[i]);
+      ok = 0;
+      continue;
+    }
+    if(st.type != T_FILE ||
+       (i % 3 == 1 && (st.rwmode != 2 || st.showmode != 1)) ||
+       (i % 3 == 2 && st.showmode != 0)){
+      printf("fsbatchtest: %s has type %d rwmode %d showmode %d\n",
+             names[i], st.type, st.rwmode, st.showmode);
+      ok = 0;
+    }
+    close(fd);
+  }
+
+  // failures are reported per op and do not stop the batch
+  ops[0].op = FSOP_UNLINK;
+  ops[0].path = names[0];
+  ops[1].op = FSOP_UNLINK;
+  ops[1].path = names[1];
+  if(fsbatch(ops, 2) != 1 || ops[0].status != -1 || ops[1].status != 0)
+    ok = 0;
+
+  for(i = 2; i < N; i++)
+    if(i % 3 != 0)
+      unlink(names[i]);
+  unlink("fsbt");
+
+  printf(ok ? "fsbatchtest ok\n" : "fsbatchtest failed\n");
+  exit(ok ? 0 : 1);
+}
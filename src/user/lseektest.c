@@ -22,6 +22,58 @@ main(int argc, char *argv[])
   lseek(fd, -2, SEEK_END);
   write(fd, "333", 3);
 
+  // past the end: leaves a hole that reads back as zeros
+  lseek(fd, 2000, SEEK_END);
+  write(fd, "444", 3);
+
+  char buf[2000];
+  struct stat st;
+  lseek(fd, 21, SEEK_SET);
+  if(read(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf("lseektest: short read of hole\n");
+    exit(1);
+  }
+  for(int i = 0; i < sizeof(buf); i++){
+    if(buf[i] != 0){
+      printf("lseektest: hole byte %d is %d\n", 21 + i, buf[i]);
+      exit(1);
+    }
+  }
+  if(read(fd, buf, 3) != 3 || memcmp(buf, "444", 3) != 0){
+    printf("lseektest: data after hole\n");
+    exit(1);
+  }
+  close(fd);
+
+  // a file past 4GB, mostly hole
+  int64 big = 5LL << 30;
+  fd = open("lseektest2.txt", O_CREATE|O_RDWR,"iam@admin9876");
+  if(lseek(fd, big, SEEK_SET) != big || write(fd, "555", 3) != 3){
+    printf("lseektest: write past 4GB failed\n");
+    exit(1);
+  }
+  if(fstat(fd, &st) < 0 || st.size != big + 3){
+    printf("lseektest: bad size past 4GB\n");
+    exit(1);
+  }
+  lseek(fd, big - sizeof(buf), SEEK_SET);
+  if(read(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf("lseektest: short read past 4GB\n");
+    exit(1);
+  }
+  for(int i = 0; i < sizeof(buf); i++){
+    if(buf[i] != 0){
+      printf("lseektest: hole byte past 4GB is %d\n", buf[i]);
+      exit(1);
+    }
+  }
+  if(read(fd, buf, 3) != 3 || memcmp(buf, "555", 3) != 0){
+    printf("lseektest: data past 4GB\n");
+    exit(1);
+  }
   close(fd);
+  unlink("lseektest2.txt");
+
+  printf("lseektest ok\n");
   exit(0);
 }
\ No newline at end of file
@@ -0,0 +1,94 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+
+// Several processes overwrite one large file at once through a
+// shared descriptor: each owns a range of blocks, and all of
+// them also overwrite one common range. Overwrites of blocks a
+// file already has run under block-range locks, so each
+// process's range must come out as it wrote it, and the common
+// range must be all one process's write, never a mix.
+
+#define NCHILD  4
+#define OWN     6                  // blocks each child owns
+#define COMMON  (NCHILD*OWN)       // first block of the common range
+#define NCOMMON 4                  // blocks in the common range
+#define NBLK    (COMMON+NCOMMON)
+#define ROUNDS  30
+
+char buf[OWN*BSIZE];
+char rbuf[OWN*BSIZE];
+
+void
+fail(char *msg)
+{
+  printf("overwritetest: %s\n", msg);
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, i, r, k, pid, st;
+  char c;
+
+  fd = open("owtest", O_CREATE|O_RDWR|O_TRUNC, "iam@admin9876");
+  if(fd < 0)
+    fail("create");
+  memset(buf, 0, BSIZE);
+  for(i = 0; i < NBLK; i++)
+    if(write(fd, buf, BSIZE) != BSIZE)
+      fail("fill");
+
+  for(i = 0; i < NCHILD; i++){
+    if((pid = fork()) < 0)
+      fail("fork");
+    if(pid == 0){
+      c = 'a' + i;
+      for(r = 0; r < ROUNDS; r++){
+        // the whole own range, then an unaligned piece of it
+        memset(buf, c, sizeof(buf));
+        if(pwrite(fd, buf, OWN*BSIZE, i*OWN*BSIZE) != OWN*BSIZE)
+          fail("pwrite own");
+        if(pwrite(fd, buf, 3*BSIZE - 200, i*OWN*BSIZE + BSIZE + 100) != 3*BSIZE - 200)
+          fail("pwrite own unaligned");
+        if(pread(fd, rbuf, OWN*BSIZE, i*OWN*BSIZE) != OWN*BSIZE)
+          fail("pread own");
+        for(k = 0; k < OWN*BSIZE; k++)
+          if(rbuf[k] != c)
+            fail("own range overwritten by another process");
+
+        memset(buf, c, NCOMMON*BSIZE);
+        if(pwrite(fd, buf, NCOMMON*BSIZE, COMMON*BSIZE) != NCOMMON*BSIZE)
+          fail("pwrite common");
+      }
+      exit(0);
+    }
+  }
+  for(i = 0; i < NCHILD; i++){
+    wait(&st);
+    if(st != 0)
+      fail("child failed");
+  }
+
+  for(i = 0; i < NCHILD; i++){
+    if(pread(fd, rbuf, OWN*BSIZE, i*OWN*BSIZE) != OWN*BSIZE)
+      fail("pread");
+    for(k = 0; k < OWN*BSIZE; k++)
+      if(rbuf[k] != 'a' + i)
+        fail("own range wrong");
+  }
+  if(pread(fd, rbuf, NCOMMON*BSIZE, COMMON*BSIZE) != NCOMMON*BSIZE)
+    fail("pread common");
+  if(rbuf[0] < 'a' || rbuf[0] >= 'a' + NCHILD)
+    fail("common range wrong");
+  for(k = 0; k < NCOMMON*BSIZE; k++)
+    if(rbuf[k] != rbuf[0])
+      fail("common range mixes two writes");
+  close(fd);
+  unlink("owtest");
+  printf("overwritetest ok\n");
+  exit(0);
+}
@@ -0,0 +1,73 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+
+// pread/pwrite: positional reads and writes that leave the
+// file offset where it was, also across fork().
+
+char big[4*BSIZE];
+
+int
+main(int argc, char *argv[])
+{
+  char buf[8];
+  int fd, i, ok = 1;
+  uint64 off;
+
+  fd = open("preadtest.txt", O_CREATE|O_RDWR, "iam@admin9876");
+  for(i = 0; i < 20; i++)
+    write(fd, "0", 1);
+
+  // a small file, kept in the inode
+  pwrite(fd, "111", 3, 4);
+  if(lseek(fd, 0, SEEK_CUR) != 20)
+    ok = 0;
+  if(pread(fd, buf, 5, 3) != 5 || memcmp(buf, "01110", 5) != 0)
+    ok = 0;
+
+  // grow it well past IDATASIZE to several blocks, so that
+  // overwrites below go to mapped blocks
+  memset(big, '0', sizeof(big));
+  for(i = 0; i < 2; i++)
+    if(write(fd, big, sizeof(big)) != sizeof(big))
+      ok = 0;
+  off = 20 + 2*sizeof(big);
+  if(lseek(fd, 0, SEEK_CUR) != off)
+    ok = 0;
+
+  // across a block boundary
+  pwrite(fd, "444", 3, BSIZE - 1);
+  if(pread(fd, buf, 5, BSIZE - 2) != 5 || memcmp(buf, "04440", 5) != 0)
+    ok = 0;
+  if(lseek(fd, 0, SEEK_CUR) != off)
+    ok = 0;
+
+  // parent and child share the offset but not pread's
+  if(fork() == 0){
+    pwrite(fd, "222", 3, 5*BSIZE + 10);
+    if(pread(fd, buf, 5, BSIZE - 2) != 5 || lseek(fd, 0, SEEK_CUR) != off)
+      exit(1);
+    exit(0);
+  }
+  wait(&i);
+  if(i != 0)
+    ok = 0;
+  if(pread(fd, buf, 5, 5*BSIZE + 9) != 5 || memcmp(buf, "02220", 5) != 0)
+    ok = 0;
+  if(lseek(fd, 0, SEEK_CUR) != off)
+    ok = 0;
+
+  // past the end: pwrite leaves a hole, pread stops at the end
+  pwrite(fd, "333", 3, 20*BSIZE);
+  if(pread(fd, buf, 8, 20*BSIZE) != 3 || pread(fd, buf, 1, 15*BSIZE) != 1 || buf[0] != 0)
+    ok = 0;
+  if(lseek(fd, 0, SEEK_CUR) != off)
+    ok = 0;
+
+  close(fd);
+  unlink("preadtest.txt");
+  printf(ok ? "preadtest ok\n" : "preadtest failed\n");
+  exit(ok ? 0 : 1);
+}
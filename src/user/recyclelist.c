@@ -3,6 +3,8 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 
+#define NENTS 16  // directory entries per getdents()
+
 
 char *
 fmtname(char *path)
@@ -25,9 +27,9 @@ fmtname(char *path)
 
 void recyclelist(char *path)
 {
-  char buf[512], *p,buf_leaf[257];
-  int fd;
-  struct dirent de;
+  char buf[512], *p;
+  int fd, i, n;
+  struct direntplus ents[NENTS];
   struct stat st;
 
   if ((fd = open(path, 0, "iam@admin9876")) < 0)
@@ -62,25 +64,14 @@ void recyclelist(char *path)
     strcpy(buf, path);
     p = buf+strlen(buf);
     *p++ = '/';
-    // @author:maqi
-    // 按照叶块来读,一次读入1个叶块，16个目录项
-    while(read(fd, buf_leaf, 16*sizeof(de)) == 16*sizeof(de)){
-      for(int i=0;i<16;i++)
+    // 一次取回NENTS个目录项及其属性，不必逐个stat
+    while((n = getdents(fd, ents, NENTS)) > 0){
+      for(i = 0; i < n; i++)
       {
-        memcpy((char*)&de,buf_leaf+i*sizeof(de),sizeof(de));
-        //strncpy(buf_leaf+i*sizeof(de),(char*)&de,sizeof(de));
-        if(de.inum == 0)
-          break;
-        memmove(p, de.name, DIRSIZ);
-        p[DIRSIZ] = 0;
-        if(stat(buf, &st) < 0){
-          printf("recyclelist: cannot stat %s\n", buf);
-          continue;
-        }
-        
-        if(st.showmode == 0){
+        strcpy(p, ents[i].name);
+        if(ents[i].showmode == 0){
           // @author:ply
-          printf("%s %d %d %d %d %d\n", fmtname(buf), st.rwmode, st.supermode, st.type, st.ino, st.size);
+          printf("%s %d %d %d %d %l\n", fmtname(buf), ents[i].rwmode, ents[i].supermode, ents[i].type, ents[i].ino, ents[i].size);
           // printf("%s %d %d %d\n", fmtname(buf), st.type, st.ino, st.size);
         }
         // else{
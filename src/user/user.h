@@ -2,6 +2,9 @@ struct stat;
 struct rtcdate;
 struct sysinfo;
 struct superblock;
+struct defragstat;
+struct direntplus;
+struct fsop;
 
 // system calls
 int sysinfo(struct sysinfo *);
@@ -28,7 +31,12 @@ int sleep(int);
 int uptime(void);
 int fsinfo(struct superblock*);
 int showstat(struct stat*);
-int lseek(int, int, int);
+int64 lseek(int, int64, int);
+int pread(int, void*, int, int64);
+int pwrite(int, const void*, int, int64);
+int defrag(int, struct defragstat*);
+int getdents(int, struct direntplus*, int);
+int fsbatch(struct fsop*, int);
 
 //new
 int chmode(char *pathname, int mode);
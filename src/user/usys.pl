@@ -45,3 +45,8 @@ entry("showstat");
 entry("delete");
 entry("show");
 entry("lseek");
+entry("defrag");
+entry("getdents");
+entry("fsbatch");
+entry("pread");
+entry("pwrite");